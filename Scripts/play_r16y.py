@@ -4,12 +4,17 @@ import serial, sys, time, os, bz2, gc
 # disable gc
 gc.disable()
 
+# -c: credit based refill (device grants frames, we stream packets back-to-back)
+credit = '-c' in sys.argv
+if credit:
+  sys.argv.remove('-c')
+
 argv_offset = 0
 if (sys.argv[0].startswith("python")):
   argv_offset = 1
 
 if len(sys.argv) < (3 + argv_offset):
-  sys.stderr.write('Usage: ' + (sys.argv[0] if argv_offset == 1 else '') + sys.argv[0 + argv_offset] + ' <interface> <replayfile>\n\n')
+  sys.stderr.write('Usage: ' + (sys.argv[0] if argv_offset == 1 else '') + sys.argv[0 + argv_offset] + ' [-c] <interface> <replayfile>\n\n')
   sys.exit(0)
 	
 if not os.path.exists(sys.argv[2 + argv_offset]):
@@ -54,6 +59,10 @@ time.sleep(0.1)
 #ser.write(bytes([0xC0, 1, 1]))  # set autolatch on controller port 2
 #ser.write(bytes([0xC1, 16])) 	# 16-bit autolatching
 
+# credit based refill
+if credit:
+	ser.write(bytes([0x0E, 0x01]))
+
 # start run
 print("--- Sending start command to device")
 ser.write(b'\x01\x02\x02\x02\x00\x00\x00') # command 1 (play), 16-bits, 2 port, 2 datalines, sync, no window 1, no window 2
@@ -69,10 +78,38 @@ cmd = None
 data = None
 inputs = None
 
+def packet(frames):
+	inputs = f.read(frames * 16)
+	data = []
+	for i in range(0, len(inputs), 16):
+		data = data + [inputs[i], inputs[i+1], inputs[i+2], inputs[i+3]]
+		data = data + [inputs[i+8], inputs[i+9], inputs[i+10], inputs[i+11]]
+	return data
+
 print("--- Starting read loop")
 while True:
 	cmd = ser.read()
-	if cmd == b'\x0F':
+	if cmd == b'\x0E':
+		# credit grant, fill it with full 7 frame packets in one write
+		grant = ser.read(2)
+		frames = (grant[0] << 8) | grant[1]
+		out = bytearray()
+		while frames > 0:
+			n = min(frames, 7)
+			data = packet(n)
+			if len(data) == 0:
+				break
+			pkt = bytes([0x0F] + data)
+			if len(data) == 7 * 8:
+				# pad to a full USB packet so the next one starts on a packet boundary
+				pkt += bytes(64 - len(pkt))
+			out += pkt
+			frames = frames - n
+			latches = latches + n
+		ser.write(out)
+		if len(out) > 0:
+			print('*** Latches: [%d] - Data: [%x]' % (latches, out[1]))
+	elif cmd == b'\x0F':
 		if extra > 0:
 			inputs = f.read(112 - (extra * 16))
 			data = []
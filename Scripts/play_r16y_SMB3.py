@@ -50,6 +50,12 @@ ser.write(bytes([0xA1, 0x08, 0x4A])) # 2121
 ser.write(bytes([0xA4, 128])) # Port 1 timer (128 = 5us)
 ser.write(bytes([0xB4, 128])) # Port 2 timer (128 = 5us)
 
+# switch off DPCM fix on both ports at this latch, done by the device
+switch_at = 16800
+ser.write(bytes([0xA5, 2,
+	(switch_at >> 24) & 0xFF, (switch_at >> 16) & 0xFF, (switch_at >> 8) & 0xFF, switch_at & 0xFF, 0xA4, 2, 0,
+	(switch_at >> 24) & 0xFF, (switch_at >> 16) & 0xFF, (switch_at >> 8) & 0xFF, switch_at & 0xFF, 0xB4, 2, 0]))
+
 # autolatcher (automatically triggers a latch every n'th clock of the selected controller)
 #ser.write(bytes([0xC0, 1, 1]))  # set autolatch on controller port 2
 #ser.write(bytes([0xC1, 16])) 	# 16-bit autolatching
@@ -69,10 +75,6 @@ cmd = None
 data = None
 inputs = None
 
-# set to True to turn off DPCM fix at a specific frame
-switch = True
-switch_at = 16800
-
 print("--- Starting read loop")
 while True:
 	cmd = ser.read()
@@ -98,10 +100,5 @@ while True:
 		
 		latches = latches + 7			
 
-		if latches > switch_at and switch == True:
-			ser.write(bytes([0xA4, 2])) #
-			ser.write(bytes([0xB4, 2])) # switch off DPCM fix on both ports
-			switch = False
-
 		if latches % 60 == 0:
 			print('*** Latches: [%d] - Data: [%x]' % (latches, data[0]))
@@ -0,0 +1,147 @@
+#!/usr/bin/python3
+# Loopback test: the simulator plays the device on a pty (tasbot_sim -P) and
+# the real host side streams a movie to it, once per refill mode, frame
+# coding and way of taking latches, resumed at a latch, and with a JOYBUS 1
+# build (tasbot_sim_joybus) answering polls. The simulator checks every
+# frame it presents against the movie and exits non-zero on a mismatch or
+# an underrun.
+#
+# Usage: loopback.py [frames]
+#   run from anywhere after "make" in Simulator/ and, for the tasbot_stream
+#   cases, building Streamer/tasbot_stream; cases whose host or simulator
+#   is missing are skipped
+
+import glob, os, random, subprocess, sys, tempfile, time
+
+here = os.path.dirname(os.path.abspath(__file__))
+root = os.path.dirname(os.path.dirname(here))
+sim = os.path.join(root, 'Simulator', 'tasbot_sim')
+sim_joybus = os.path.join(root, 'Simulator', 'tasbot_sim_joybus')
+stream = os.path.join(root, 'Streamer', 'tasbot_stream')
+scripts = os.path.join(root, 'Scripts')
+
+frames = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+# run the console this many times faster than real time
+speed = '20'
+
+# the scripts need pyserial, this directory has enough of it
+env = dict(os.environ)
+sys.path = [p for p in sys.path if os.path.abspath(p or '.') != here]
+try:
+	import serial
+except ImportError:
+	env['PYTHONPATH'] = here + os.pathsep + env.get('PYTHONPATH', '')
+
+cases = [
+	# name, host command (@ is the pty, % the movie), simulator options
+	('play_r16y.py, 0x0F requests', [sys.executable, os.path.join(scripts, 'play_r16y.py'), '@', '%'], ['-e', '1']),
+	('play_r16y.py, credit refill', [sys.executable, os.path.join(scripts, 'play_r16y.py'), '-c', '@', '%'], ['-e', '1']),
+	('tasbot_stream, 0x0F requests', [stream, '-e', '1', '@', '%'], ['-e', '1']),
+	('tasbot_stream, credit refill', [stream, '-e', '1', '-b', '@', '%'], ['-e', '1']),
+	('tasbot_stream -z, 0x10 requests', [stream, '-e', '1', '-z', '@', '%'], ['-e', '1']),
+	('tasbot_stream -z, credit refill', [stream, '-e', '1', '-z', '-b', '@', '%'], ['-e', '1']),
+	# the window timer and autolatch ISRs leave the frame to PendSV: two
+	# latches a frame inside a 2 ms window, and a SNES read autolatched
+	('tasbot_stream, window mode', [stream, '-e', '1', '-w', '48000', '@', '%'], ['-e', '1', '-x', '2']),
+	('tasbot_stream, autolatch', [stream, '-e', '1', '-a', '0:16', '@', '%'], ['-e', '1', '-c', 'snes']),
+]
+
+# resumed inside a packet where the movie is not held, 1129 is 161 packets
+# of 7 frames and 2: compiled from there while streaming with nothing
+# cached, then sliced out of the cache entry of the whole movie
+resume_cases = [
+	('tasbot_stream -L, compiled', [stream, '-e', '1', '-L', '1129', '@', '%'], ['-e', '1', '-L', '1129']),
+	('tasbot_stream -z -L, compiled', [stream, '-e', '1', '-z', '-L', '1129', '@', '%'], ['-e', '1', '-L', '1129']),
+]
+cached_cases = [
+	('tasbot_stream -L, cached', [stream, '-e', '1', '-L', '1129', '@', '%'], ['-e', '1', '-L', '1129']),
+	('tasbot_stream -z -L, cached', [stream, '-e', '1', '-z', '-L', '1129', '@', '%'], ['-e', '1', '-L', '1129']),
+]
+
+# the same, staged into the joybus FIFOs for the next poll
+joybus_cases = [
+	('tasbot_stream, joybus', [stream, '-e', '1', '@', '%'], ['-e', '1']),
+	('tasbot_stream -z, joybus credit', [stream, '-e', '1', '-z', '-b', '@', '%'], ['-e', '1']),
+]
+
+def run(name, host, options, movie, device=sim):
+	for path in (host[0], device):
+		if not os.path.exists(path):
+			print('%-32s skipped, no %s' % (name, os.path.basename(path)))
+			return True
+
+	dev = subprocess.Popen([device, '-P', '-S', speed, '-n', str(frames)] + options + [movie],
+		stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+	pty = dev.stdout.readline().split()[-1]
+	cmd = [pty if a == '@' else movie if a == '%' else a for a in host]
+	h = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, env=env)
+
+	# the device exits once it has played the frames, the scripts never do
+	deadline = time.time() + 60 + frames / 60.0
+	while dev.poll() is None and time.time() < deadline and h.poll() in (None, 0):
+		time.sleep(0.1)
+	if dev.poll() is None:
+		dev.kill()
+		out, _ = dev.communicate()
+		if h.poll():
+			out += 'host failed: ' + h.stderr.read().decode(errors='replace')
+		else:
+			out += 'timed out\n'
+	else:
+		out, _ = dev.communicate()
+	if h.poll() is None:
+		h.kill()
+	h.wait()
+
+	result = out.splitlines()[0] if out else 'no output'
+	ok = dev.returncode == 0
+	print('%-32s %s  %s' % (name, 'ok' if ok else 'FAIL', result))
+	if not ok:
+		sys.stdout.write(out)
+	return ok
+
+if not os.path.exists(sim):
+	sys.stderr.write('Error: build %s first\n' % sim)
+	sys.exit(1)
+
+with tempfile.TemporaryDirectory() as tmp:
+	movie = os.path.join(tmp, 'loopback.r16y')
+	env['XDG_CACHE_HOME'] = tmp
+	rnd = random.Random(1)
+	# longer than the device's ring ahead of it: play_r16y.py without -c
+	# stops at the end of the movie and the device would see it go. Frames
+	# are held for a while now and then, as in a TAS, so -z sends runs.
+	with open(movie, 'wb') as f:
+		left = frames + 8192
+		while left > 0:
+			held = rnd.randint(2, 400) if rnd.random() < 0.1 else 1
+			held = min(held, left)
+			f.write(bytes(rnd.getrandbits(8) for i in range(16)) * held)
+			left -= held
+
+	failed = 0
+	# first, while the cache is empty
+	for name, host, options in resume_cases:
+		if not run(name, host, options, movie):
+			failed += 1
+		time.sleep(0.2)
+	if glob.glob(os.path.join(tmp, 'tasbot', '*.pkt')):
+		print('%-32s FAIL  a resumed run cached its packets' % 'tasbot_stream -L')
+		failed += 1
+	for name, host, options in cases:
+		if not run(name, host, options, movie):
+			failed += 1
+		time.sleep(0.2)
+	# a run can stop before its compile is through and cache nothing
+	if os.path.exists(stream):
+		subprocess.run([stream, '-e', '1', '-x', movie], stdout=subprocess.DEVNULL, env=env, check=True)
+	for name, host, options in cached_cases:
+		if not run(name, host, options, movie):
+			failed += 1
+		time.sleep(0.2)
+	for name, host, options in joybus_cases:
+		if not run(name, host, options, movie, sim_joybus):
+			failed += 1
+		time.sleep(0.2)
+
+sys.exit(1 if failed else 0)
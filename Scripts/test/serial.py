@@ -0,0 +1,34 @@
+# The little of pyserial the play_*.py scripts use, for the loopback test
+# on machines without it: a raw tty opened by path, read() with a timeout.
+# loopback.py only puts this on the path when "import serial" fails.
+
+import os, select, termios, tty
+
+class Serial:
+	def __init__(self, port, baudrate=9600, timeout=None):
+		self.timeout = timeout
+		self.fd = os.open(port, os.O_RDWR | os.O_NOCTTY)
+		tty.setraw(self.fd, termios.TCSANOW)
+
+	def read(self, size=1):
+		out = b''
+		while len(out) < size:
+			r, _, _ = select.select([self.fd], [], [], self.timeout)
+			if not r:
+				break
+			try:
+				data = os.read(self.fd, size - len(out))
+			except OSError:
+				break
+			if not data:
+				break
+			out += data
+		return out
+
+	def write(self, data):
+		data = bytes(data)
+		while data:
+			data = data[os.write(self.fd, data):]
+
+	def close(self):
+		os.close(self.fd)
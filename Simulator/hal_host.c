@@ -0,0 +1,273 @@
+/* ========================================
+ * Host side of hal.h and usbin.h
+ *
+ * Register writes land in sim_hw and are charged
+ * to the running ISR. USB packets travel over a
+ * simulated wire with a delivery time each and
+ * only reach the staging ring once that time has
+ * passed and a slot is free.
+ * ========================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+struct sim_hw sim_hw;
+
+uint8 hal_flash_store[FLASH_STORE_BYTES];
+
+#define SIM_WIRE_SIZE 4096
+
+static struct
+{
+    sim_time due;
+    usbin_packet pkt;
+} wire[SIM_WIRE_SIZE];
+static unsigned wire_head = 0;
+static unsigned wire_tail = 0;
+static sim_time wire_last = 0;
+
+static usbin_packet usbin_ring[USBIN_SLOTS];
+static unsigned usbin_head = 0;
+static unsigned usbin_tail = 0;
+
+void hal_console_write(uint16 p1d0, uint16 p1d1, uint16 p2d0, uint16 p2d1)
+{
+    sim_hw.regs[0] = p1d0;
+    sim_hw.regs[1] = p1d1;
+    sim_hw.regs[2] = p2d0;
+    sim_hw.regs[3] = p2d1;
+    sim_hw.isr_cycles += 4 * SIM_REG_WRITE_CYCLES;
+    sim_hw.isr_ready = sim_hw.isr_cycles;
+}
+
+void hal_vis_write(uint16 p1d0, uint16 p1d1, uint16 p2d0, uint16 p2d1)
+{
+    (void) p1d0;
+    (void) p1d1;
+    (void) p2d0;
+    (void) p2d1;
+    sim_hw.isr_cycles += 8 * SIM_REG_WRITE_CYCLES;
+}
+
+void hal_defer(void)
+{
+    sim_hw.defer_pending = 1;
+    sim_hw.isr_cycles += SIM_REG_WRITE_CYCLES;
+}
+
+/* simulated time, with what the running ISR has spent so far */
+uint32 hal_cycles(void)
+{
+    return (uint32)(sim_now + sim_hw.isr_cycles);
+}
+
+void hal_latch_irq_start(void)
+{
+    sim_hw.latch_irq = 1;
+}
+
+void hal_latch_irq_stop(void)
+{
+    sim_hw.latch_irq = 0;
+}
+
+void hal_latch_dma_start(const volatile void *slot0, const volatile void *slot1, int first)
+{
+    sim_hw.dma_slot[0] = slot0;
+    sim_hw.dma_slot[1] = slot1;
+    sim_hw.dma_next = first;
+    sim_hw.latch_dma = 1;
+}
+
+void hal_latch_dma_stop(void)
+{
+    sim_hw.latch_dma = 0;
+}
+
+/* latch_dma_stage: a status read, then disable, initial TD and enable */
+void hal_latch_dma_stage(int slot)
+{
+    sim_hw.dma_next = slot;
+    sim_hw.isr_cycles += 4 * SIM_REG_WRITE_CYCLES;
+}
+
+void hal_joybus_start(void)
+{
+    sim_hw.joybus = 1;
+}
+
+void hal_joybus_mode(int gc)
+{
+    sim_hw.joybus_gc = gc;
+}
+
+/* the FIFOs are cleared and refilled: a busy read, two aux control writes,
+ * eight bytes. Polls are answered the moment they come, so there is never
+ * an answer going out to wait for. */
+void hal_joybus_stage(const volatile uint16 *line)
+{
+    int k;
+
+    for (k = 0; k < 4; k++)
+    {
+        sim_hw.joybus_fifo[k] = line[k];
+    }
+    sim_hw.joybus_staged = 1;
+    sim_hw.isr_cycles += 11 * SIM_REG_WRITE_CYCLES;
+}
+
+void hal_autolatch_start(void)
+{
+    sim_hw.autolatch = 1;
+    sim_hw.autolatch_count = sim_hw.autolatch_period;
+}
+
+void hal_autolatch_stop(void)
+{
+    sim_hw.autolatch = 0;
+}
+
+void hal_autolatch_period(uint8 bits)
+{
+    sim_hw.autolatch_period = bits;
+}
+
+void hal_autolatch_select(uint8 port)
+{
+    sim_hw.autolatch_port = port;
+}
+
+void hal_autolatch_reload(uint8 bits)
+{
+    sim_hw.autolatch_count = bits;
+    sim_hw.isr_cycles += SIM_REG_WRITE_CYCLES;
+}
+
+void hal_autolatch_ack(void)
+{
+    sim_hw.isr_cycles += SIM_REG_WRITE_CYCLES;
+}
+
+void hal_clock_filter_period(uint8 port, uint8 period)
+{
+    sim_hw.clock_filter_period[port & 1] = period;
+}
+
+void hal_window_period(uint8 port, uint16 period)
+{
+    sim_hw.window_period[port & 1] = period;
+}
+
+int hal_usb_configured(void)
+{
+    return 1;
+}
+
+void hal_usb_putc(uint8 c)
+{
+    sim_host_rx(&c, 1);
+}
+
+void hal_usb_write(const uint8 *buf, uint16 len)
+{
+    sim_host_rx(buf, len);
+}
+
+int hal_flash_start(void)
+{
+    return 1;
+}
+
+/* a row write takes milliseconds on the PSoC; the sim only copies it */
+int hal_flash_write(const volatile uint8 *dst, const uint8 *row)
+{
+    memcpy((uint8 *)dst, row, HAL_FLASH_ROW_BYTES);
+    return 1;
+}
+
+void sim_wire_send(const uint8 *buf, int len, sim_time due)
+{
+    if (wire_head - wire_tail == SIM_WIRE_SIZE)
+    {
+        return;
+    }
+    if (due < wire_last)
+    {
+        due = wire_last;
+    }
+    wire[wire_head % SIM_WIRE_SIZE].due = due;
+    memcpy(wire[wire_head % SIM_WIRE_SIZE].pkt.data, buf, len);
+    wire[wire_head % SIM_WIRE_SIZE].pkt.bytes = len;
+    wire_head++;
+    wire_last = due;
+}
+
+sim_time sim_wire_next_due(void)
+{
+    return (wire_head == wire_tail) ? 0 : wire[wire_tail % SIM_WIRE_SIZE].due;
+}
+
+sim_time sim_wire_last_due(void)
+{
+    return wire_last;
+}
+
+void usbin_reset(void)
+{
+    usbin_head = 0;
+    usbin_tail = 0;
+}
+
+void usbin_poll(void)
+{
+    while (usbin_head - usbin_tail < USBIN_SLOTS && wire_head != wire_tail
+           && wire[wire_tail % SIM_WIRE_SIZE].due <= sim_now)
+    {
+        usbin_ring[usbin_head % USBIN_SLOTS] = wire[wire_tail % SIM_WIRE_SIZE].pkt;
+        usbin_head++;
+        wire_tail++;
+    }
+}
+
+usbin_packet *usbin_peek(void)
+{
+    if (usbin_head == usbin_tail)
+    {
+        return NULL;
+    }
+    return &usbin_ring[usbin_tail % USBIN_SLOTS];
+}
+
+usbin_packet *usbin_wait(void)
+{
+    usbin_packet *pkt;
+
+    while (NULL == (pkt = usbin_peek()))
+    {
+        if (wire_head == wire_tail && !sim_wire_wait())
+        {
+            /* the host never answers, nothing in the sim can change that */
+            fprintf(stderr, "device waits for a packet the host will never send\n");
+            exit(1);
+        }
+        if (wire_head != wire_tail)
+        {
+            sim_run_until(wire[wire_tail % SIM_WIRE_SIZE].due);
+        }
+        usbin_poll();
+    }
+    return pkt;
+}
+
+void usbin_release(void)
+{
+    if (usbin_head != usbin_tail)
+    {
+        usbin_tail++;
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,1092 @@
+/* ========================================
+ * TASBot replay simulator
+ *
+ * Runs the firmware replay core (replay.c) on the
+ * host against a simulated console and a simulated
+ * host PC. The console latches at NTSC frame rate
+ * and clocks 8 (NES) or 16 (SNES) bits per latch,
+ * every edge calls the same ISR entry points the
+ * PSoC interrupts call. The host answers refill
+ * requests after a configurable latency.
+ *
+ * Build (or make, make test for the unit tests):
+ *   gcc -O2 -DTASBOT_HOST -I../TASBot.cydsn -o tasbot_sim \
+ *       sim.c hal_host.c ../TASBot.cydsn/replay.c ../TASBot.cydsn/decode.c \
+ *       ../TASBot.cydsn/telemetry.c ../TASBot.cydsn/timing.c ../TASBot.cydsn/flash.c \
+ *       ../TASBot.cydsn/events.c
+ *
+ * -DVIS_ENABLE=0 builds without the visualization,
+ * -DTIMING_ENABLE=0 without the ISR timing,
+ * -DLATCH_DMA=1 with latch triggered DMA playback:
+ * the latch copies the staged slot to the registers
+ * in a fixed SIM_DMA_TD_CYCLES per word and raises
+ * the DMA's nrq ISR. -DJOYBUS=1 with joybus
+ * playback: each latch is a poll answered with the
+ * frame last staged into the component's FIFOs,
+ * then the poll ISR.
+ *
+ * Usage:
+ *   tasbot_sim [options] <movie>
+ *     -c nes|snes   console timing (default nes)
+ *     -f format     r08, r16y, r16m (default r16y)
+ *     -n frames     stop after this many frames
+ *     -l us         host response latency (default 2000)
+ *     -p us         time per USB packet (default 50)
+ *     -x latches    latches per frame (default 1)
+ *     -g us         gap between latches of one frame (default 1000)
+ *     -b            use credit based refill
+ *     -B calls      no movie, time this many latch ISRs back to back
+ *     -P            be the device on a pty instead of simulating the
+ *                   host; the pty is printed, point a host streamer
+ *                   at it (see Streamer/stream.cpp)
+ *     -S factor     with -P, run the console this many times faster
+ *                   than real time (default 1)
+ *     -e frames     with -P, the host sends this many blank frames
+ *                   before the movie (tasbot_stream -e, play_r16y.py)
+ *     -F image      load a flash image (tasbot_stream -W) into the
+ *                   flash store and play it with 0xF3, the host
+ *                   only checks what is presented against the movie
+ *     -H image      as -F, but start with 0xF4 so the image is the
+ *                   prefix of the run and the host streams the rest
+ *     -z            send run length coded 0x10 packets, encoded here
+ *                   the way the streamer does it
+ *     -L latch      resume the run at this latch with 0x02, as
+ *                   tasbot_stream -L does
+ *
+ * On USB each host write is a transfer of 64 byte
+ * packets and the firmware takes one command per
+ * packet, ignoring what follows it. A pty loses the
+ * write boundaries, and writes sent back to back come
+ * out of it as one read, so host commands are split
+ * by their length. A 0x0F or 0x10 packet is 64 bytes
+ * unless it is the last thing in its write. 0x01
+ * and 0x02 end their write, as the host waits for
+ * the preload requests after them, so anything after
+ * them in the read belongs to their packet, like the
+ * window bytes play_r16y.py sends with 0x01.
+ *
+ * ISR cost is accounted in bus cycles from exception
+ * entry/exit and every peripheral access made through
+ * the HAL; host wall time per call is reported next
+ * to it for comparing code changes. A PendSV pended
+ * by an ISR runs right after it, as it tail-chains
+ * on the PSoC.
+ * ========================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <decode.h>
+#include <flash.h>
+#include "sim.h"
+
+/* NTSC NES and SNES both run at ~60.0988 frames per second */
+#define SIM_FRAME_CYCLES   ((sim_time)(SIM_BUS_HZ * 10000ULL / 600988ULL))
+#define SIM_CLOCK_US       12
+#define SIM_DEADLINE_US    12
+/* most frames in one 0x10 packet, as the streamer packs them */
+#define SIM_RLE_FRAMES     1024
+
+struct sim_format
+{
+    const char *name;
+    int databits;
+    int ports;
+    int lines;
+    int stride;
+    int pick[12];
+};
+
+static const struct sim_format formats[] =
+{
+    { "r08",  1, 2, 1,  2, { 0, 1 } },
+    { "r16y", 2, 2, 2, 16, { 0, 1, 2, 3, 8, 9, 10, 11 } },
+    { "r16m", 2, 2, 3, 16, { 0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13 } },
+};
+
+struct sim_isr_stats
+{
+    const char *name;
+    unsigned long calls;
+    unsigned cycles_min;
+    unsigned cycles_max;
+    unsigned long long cycles_total;
+    unsigned ready_max;
+    unsigned long ns_min;
+    unsigned long ns_max;
+    unsigned long long ns_total;
+};
+
+sim_time sim_now = 0;
+
+static const struct sim_format *fmt;
+static uint8 *movie;
+static long movie_frames;
+static long movie_cursor = 0;
+static int blocksize;
+static int frames_per_packet;
+/* send 0x10 packets, and the last literal frame sent in one */
+static int rle = 0;
+/* latch the run is resumed at with 0x02, the movie is sent from that frame */
+static long resume = 0;
+/* blank frames a pty host sends before the movie */
+static long blank = 0;
+static uint8 rle_last[12];
+static int rle_have_last = 0;
+
+static sim_time host_latency = SIM_US(2000);
+static sim_time packet_time = SIM_US(50);
+static int clocks_per_latch = 8;
+static int latches_per_frame = 1;
+static sim_time latch_gap = SIM_US(1000);
+
+static sim_time frame_start;
+static sim_time next_latch;
+static int latch_in_frame = 0;
+static sim_time next_clock;
+static int clocks_left = 0;
+static sim_time timer_due = 0;
+
+static long played = 0;
+/* movie frame the next latch should present: each latch moves on by one,
+ * in window mode each frame's burst of latches */
+static long shown = 0;
+static long underruns = 0;
+static int underruns_seen = 0;
+static long mismatches = 0;
+static long late = 0;
+static int min_fill = RING_BYTES;
+static long requests = 0;
+static long grants = 0;
+static long packets = 0;
+
+static uint8 rx_msg;
+static uint8 rx_buf[2];
+static int rx_need = 0;
+static int rx_have = 0;
+
+/* frames in the flash image and the device's last 0x0A answer */
+static long flash_frames = 0;
+static long flash_result = -1;
+/* the image is the prefix of a streamed run (-H) */
+static int flash_handover = 0;
+
+static struct sim_isr_stats latch_stats = { "latch" };
+static struct sim_isr_stats dma_stats = { "latch dma" };
+static struct sim_isr_stats joybus_stats = { "joybus" };
+static struct sim_isr_stats timer_stats = { "timer" };
+static struct sim_isr_stats autolatch_stats = { "autolatch" };
+static struct sim_isr_stats deferred_stats = { "deferred" };
+
+static int pty_fd = -1;
+static double pty_speed = 1.0;
+static unsigned long pty_start;
+static uint8 pty_buf[4096];
+static int pty_have = 0;
+
+static unsigned long host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void run_isr(void (*isr)(void), struct sim_isr_stats *st)
+{
+    unsigned long t0, ns;
+    unsigned cycles, ready;
+
+    sim_hw.isr_cycles = SIM_ISR_ENTRY_CYCLES;
+    sim_hw.isr_ready = 0;
+
+    t0 = host_ns();
+    isr();
+    ns = host_ns() - t0;
+
+    cycles = sim_hw.isr_cycles + SIM_ISR_EXIT_CYCLES;
+    if (st->calls == 0 || cycles < st->cycles_min)
+    {
+        st->cycles_min = cycles;
+    }
+    if (cycles > st->cycles_max)
+    {
+        st->cycles_max = cycles;
+    }
+    if (sim_hw.isr_ready > st->ready_max)
+    {
+        st->ready_max = sim_hw.isr_ready;
+    }
+    if (st->calls == 0 || ns < st->ns_min)
+    {
+        st->ns_min = ns;
+    }
+    if (ns > st->ns_max)
+    {
+        st->ns_max = ns;
+    }
+    st->cycles_total += cycles;
+    st->ns_total += ns;
+    st->calls++;
+
+    if (sim_hw.defer_pending)
+    {
+        ready = sim_hw.isr_ready;
+        sim_hw.defer_pending = 0;
+        run_isr(replay_deferred, &deferred_stats);
+        sim_hw.isr_ready = ready;
+    }
+}
+
+static void expected_frame(long n, uint16 out[4])
+{
+    const uint8 *src = movie + n * fmt->stride;
+    uint8 frame[12];
+    int i, p, d, k;
+
+    for (k = 0; k < blocksize; k++)
+    {
+        frame[k] = src[fmt->pick[k]];
+    }
+
+    memset(out, 0, 4 * sizeof(uint16));
+    for (p = 0; p < fmt->ports; p++)
+    {
+        /* only two data lines per port are wired */
+        for (d = 0; d < fmt->lines && d < 2; d++)
+        {
+            k = (p * fmt->databits * fmt->lines) + (d * fmt->databits);
+            if (fmt->databits > 1)
+            {
+                for (i = 0; i < fmt->databits; i++)
+                {
+                    out[(p * 2) + d] = (out[(p * 2) + d] << 8) + frame[k + i];
+                }
+            }
+            else
+            {
+                out[(p * 2) + d] = frame[k] << 8;
+            }
+        }
+    }
+}
+
+/* frame n of the movie in 0x0F payload layout */
+static void movie_block(long n, uint8 *dst)
+{
+    int k;
+
+    for (k = 0; k < blocksize; k++)
+    {
+        dst[k] = movie[n * fmt->stride + fmt->pick[k]];
+    }
+}
+
+static void host_send_packet(const uint8 *pkt, int len, int frames, sim_time due)
+{
+    if (due < sim_wire_last_due() + packet_time)
+    {
+        due = sim_wire_last_due() + packet_time;
+    }
+    sim_wire_send(pkt, len, due);
+    if (frames > 0)
+    {
+        packets++;
+    }
+}
+
+static void host_send_frames(int frames, sim_time due)
+{
+    uint8 pkt[USBIN_PACKET_SIZE];
+    int len = 1;
+    int n;
+
+    pkt[0] = 0x0F;
+    for (n = 0; n < frames && movie_cursor < movie_frames; n++, movie_cursor++)
+    {
+        movie_block(movie_cursor, pkt + len);
+        len += blocksize;
+    }
+    host_send_packet(pkt, len, n, due);
+}
+
+/* One 0x10 packet of at most frames frames, returns the frames in it. The
+ * device's decoder is the check: any difference in how the two read the
+ * tokens shows up as mismatches. */
+static int host_send_rle(int frames, sim_time due)
+{
+    uint8 pkt[USBIN_PACKET_SIZE];
+    uint8 frame[12];
+    int len = 2, token = 0, count = 0, run = 0;
+    int n, again, open;
+
+    pkt[0] = 0x10;
+    pkt[1] = 0;
+    for (n = 0; n < frames && movie_cursor < movie_frames; n++, movie_cursor++)
+    {
+        movie_block(movie_cursor, frame);
+        again = rle_have_last && memcmp(frame, rle_last, blocksize) == 0;
+
+        /* a frame goes into the open token if it is of the same kind */
+        open = count > 0 && count < 128 && again == run;
+        if (len + !open + (again ? 0 : blocksize) > USBIN_PACKET_SIZE)
+        {
+            break;
+        }
+        if (!open)
+        {
+            token = len++;
+            run = again;
+            count = 0;
+        }
+        if (!again)
+        {
+            memcpy(pkt + len, frame, blocksize);
+            memcpy(rle_last, frame, blocksize);
+            rle_have_last = 1;
+            len += blocksize;
+        }
+        pkt[token] = (run ? RLE_RUN : 0) | count;
+        pkt[1] = len - 2;
+        count++;
+    }
+    host_send_packet(pkt, len, n, due);
+    return n;
+}
+
+/* upload a flash image as the streamer does, returns its check */
+static uint32 host_send_flash(const char *path, sim_time due)
+{
+    uint8 pkt[USBIN_PACKET_SIZE];
+    uint32 check;
+    uint8 *img;
+    FILE *f;
+    long size, pos;
+    int len;
+
+    f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error: \"%s\" not found\n", path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    img = malloc(size);
+    if (img == NULL || size < (long)sizeof(flash_header) || fread(img, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "Error: could not read \"%s\"\n", path);
+        exit(1);
+    }
+    fclose(f);
+    flash_frames = img[8] | (img[9] << 8) | (img[10] << 16) | ((long)img[11] << 24);
+    check = img[16] | (img[17] << 8) | (img[18] << 16) | ((uint32)img[19] << 24);
+
+    pkt[0] = 0xF0;
+    sim_wire_send(pkt, 1, due);
+    for (pos = 0; pos < size; pos += len - 1)
+    {
+        len = (size - pos < USBIN_PACKET_SIZE - 1) ? (int)(size - pos) + 1 : USBIN_PACKET_SIZE;
+        pkt[0] = 0xF1;
+        memcpy(pkt + 1, img + pos, len - 1);
+        sim_wire_send(pkt, len, sim_wire_last_due() + packet_time);
+    }
+    pkt[0] = 0xF2;
+    sim_wire_send(pkt, 1, sim_wire_last_due() + packet_time);
+    free(img);
+    return check;
+}
+
+void sim_host_rx(const uint8 *buf, int len)
+{
+    int i, frames;
+
+    if (pty_fd >= 0)
+    {
+        if (write(pty_fd, buf, len) != len)
+        {
+            perror("pty write");
+        }
+        return;
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        if (rx_need)
+        {
+            rx_buf[rx_have++] = buf[i];
+            if (rx_have == rx_need && rx_msg == FLASH_MSG)
+            {
+                rx_need = 0;
+                flash_result = (rx_buf[0] << 8) | rx_buf[1];
+            }
+            else if (rx_have == rx_need)
+            {
+                rx_need = 0;
+                grants++;
+                frames = (rx_buf[0] << 8) | rx_buf[1];
+                while (frames > 0 && movie_cursor < movie_frames)
+                {
+                    if (rle)
+                    {
+                        frames -= host_send_rle(frames < SIM_RLE_FRAMES ? frames : SIM_RLE_FRAMES,
+                            sim_now + host_latency);
+                        continue;
+                    }
+                    host_send_frames(frames < frames_per_packet ? frames : frames_per_packet, sim_now + host_latency);
+                    frames -= frames_per_packet;
+                }
+            }
+            continue;
+        }
+
+        switch (buf[i])
+        {
+            case 0x0F:
+                requests++;
+                if (rle)
+                {
+                    host_send_rle(SIM_RLE_FRAMES, sim_now + host_latency);
+                }
+                else
+                {
+                    host_send_frames(frames_per_packet, sim_now + host_latency);
+                }
+                break;
+            case 0x0E:
+            case FLASH_MSG:
+                rx_msg = buf[i];
+                rx_need = 2;
+                rx_have = 0;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* the latch DMA's TD chain, then its nrq; returns when the registers were loaded */
+static unsigned latch_dma(void)
+{
+    const volatile uint16 *src = sim_hw.dma_slot[sim_hw.dma_next];
+    int k;
+
+    for (k = 0; k < 4; k++)
+    {
+        sim_hw.regs[k] = src[k];
+    }
+    run_isr(replay_latch_dma_isr, &dma_stats);
+    dma_stats.ready_max = 4 * SIM_DMA_TD_CYCLES;
+    return dma_stats.ready_max;
+}
+
+/* a poll answered from the joybus FIFOs, then its ISR; a poll that finds
+ * them empty is answered late, with what the FIFOs last held */
+static unsigned joybus_poll(void)
+{
+    int k;
+    int empty = !sim_hw.joybus_staged;
+
+    for (k = 0; k < 4; k++)
+    {
+        sim_hw.regs[k] = sim_hw.joybus_fifo[k];
+    }
+    sim_hw.joybus_staged = 0;
+    run_isr(replay_joybus_isr, &joybus_stats);
+    return empty ? ~0u : 0;
+}
+
+static void on_latch(void)
+{
+    uint16 expect[4];
+    /* an autolatched console latch reads the frame the autolatch presented
+     * after the previous one, so it is checked like any other */
+    int plain = !use_timer;
+    int window = use_timer && !autolatch;
+    int presented = latches;
+    unsigned ready;
+    int fill;
+
+    if (sim_hw.latch_irq || sim_hw.latch_dma || sim_hw.joybus)
+    {
+        if (sim_hw.joybus)
+        {
+            ready = joybus_poll();
+        }
+        else if (sim_hw.latch_dma)
+        {
+            ready = latch_dma();
+        }
+        else
+        {
+            run_isr(replay_latch_isr, &latch_stats);
+            ready = sim_hw.isr_ready;
+        }
+        if (ready > SIM_US(SIM_DEADLINE_US))
+        {
+            late++;
+        }
+
+        if (playing)
+        {
+            /* a resumed run presents the frame at the latch it resumed at */
+            if (played == 0)
+            {
+                shown = presented;
+            }
+            if ((plain || window) && shown < movie_frames + blank)
+            {
+                if (shown < blank)
+                {
+                    memset(expect, 0, sizeof(expect));
+                }
+                else
+                {
+                    expected_frame(shown - blank, expect);
+                }
+                if (memcmp(expect, sim_hw.regs, sizeof(expect)) != 0)
+                {
+                    mismatches++;
+                }
+            }
+            if (plain || (window && latch_in_frame + 1 == latches_per_frame))
+            {
+                shown++;
+            }
+            played++;
+
+            /* once the host, or the flash image, is out of movie the ring
+             * drains by design */
+            if (flash_frames && !flash_handover ? played < flash_frames : movie_cursor < movie_frames)
+            {
+                fill = ring_fill();
+                if (fill < min_fill)
+                {
+                    min_fill = fill;
+                }
+                underruns += ring_underruns - underruns_seen;
+            }
+            underruns_seen = ring_underruns;
+        }
+
+        if (use_timer && playing)
+        {
+            timer_due = sim_now + (sim_time)sim_hw.window_period[0] * SIM_BUS_HZ / SIM_WINDOW_HZ;
+        }
+    }
+
+    clocks_left = clocks_per_latch;
+    next_clock = sim_now + SIM_US(SIM_CLOCK_US);
+
+    if (++latch_in_frame < latches_per_frame)
+    {
+        next_latch = sim_now + latch_gap;
+    }
+    else
+    {
+        latch_in_frame = 0;
+        frame_start += SIM_FRAME_CYCLES;
+        next_latch = frame_start;
+    }
+}
+
+static void on_clock(void)
+{
+    clocks_left--;
+    next_clock += SIM_US(SIM_CLOCK_US);
+
+    if (sim_hw.autolatch && --sim_hw.autolatch_count <= 0)
+    {
+        run_isr(replay_autolatch_isr, &autolatch_stats);
+        sim_hw.autolatch_count = sim_hw.autolatch_period;
+    }
+}
+
+static void on_timer(void)
+{
+    timer_due = 0;
+    if (sim_hw.latch_irq || sim_hw.latch_dma)
+    {
+        run_isr(replay_timer_isr, &timer_stats);
+    }
+}
+
+void sim_run_until(sim_time t)
+{
+    sim_time ev;
+
+    for (;;)
+    {
+        ev = next_latch;
+        if (clocks_left && next_clock < ev)
+        {
+            ev = next_clock;
+        }
+        if (timer_due && timer_due < ev)
+        {
+            ev = timer_due;
+        }
+        if (ev > t)
+        {
+            break;
+        }
+
+        sim_now = ev;
+        if (ev == timer_due)
+        {
+            on_timer();
+        }
+        else if (clocks_left && ev == next_clock)
+        {
+            on_clock();
+        }
+        else
+        {
+            on_latch();
+        }
+    }
+    sim_now = t;
+}
+
+/* bytes in a host command */
+static int pty_command_len(uint8 cmd)
+{
+    switch (cmd)
+    {
+        case 0x01:
+        case 0xF5:
+            return 5;
+        case 0x02:
+            return 9;
+        case 0xF4:
+            return 6;
+        case 0x0E:
+        case 0xF3:
+        case 0xA4:
+        case 0xB4:
+        case 0xC1:
+        case 0xE0:
+        case 0xE2:
+            return 2;
+        case 0xA0:
+        case 0xA1:
+        case 0xC0:
+        case 0xD0:
+        case 0xE1:
+            return 3;
+        case 0x0F:
+        case 0x10:
+        case 0xA5:
+        case 0xA6:
+        case 0xF1:
+            return USBIN_PACKET_SIZE;
+        default:
+            return 1;
+    }
+}
+
+/* wait up to timeout_us for host bytes and queue every whole command, returns commands queued */
+static int pty_receive(int timeout_us)
+{
+    struct pollfd pfd = { pty_fd, POLLIN, 0 };
+    struct timespec ts = { 0, timeout_us * 1000L };
+    int queued = 0;
+    int len, got;
+
+    for (;;)
+    {
+        if (ppoll(&pfd, 1, &ts, NULL) > 0 && pty_have < (int)sizeof(pty_buf))
+        {
+            got = read(pty_fd, pty_buf + pty_have, sizeof(pty_buf) - pty_have);
+            if (got <= 0)
+            {
+                /* the streamer went away */
+                fprintf(stderr, "host closed the pty\n");
+                exit(1);
+            }
+            pty_have += got;
+        }
+
+        while (pty_have > 0)
+        {
+            len = pty_command_len(pty_buf[0]);
+            if (len > pty_have)
+            {
+                break;
+            }
+            if (pty_buf[0] == 0x01 || pty_buf[0] == 0x02)
+            {
+                len = pty_have < USBIN_PACKET_SIZE ? pty_have : USBIN_PACKET_SIZE;
+            }
+            sim_wire_send(pty_buf, len, sim_now);
+            memmove(pty_buf, pty_buf + len, pty_have - len);
+            pty_have -= len;
+            queued++;
+        }
+
+        if (pty_have == 0)
+        {
+            return queued;
+        }
+
+        /* part of a command: a short 0x0F, 0x10, 0xA5, 0xA6 or 0xF1 packet
+         * ends its write, anything else is still on the way */
+        ts.tv_nsec = 1000000L;
+        if (poll(&pfd, 1, 1) <= 0 && pty_command_len(pty_buf[0]) == USBIN_PACKET_SIZE)
+        {
+            sim_wire_send(pty_buf, pty_have, sim_now);
+            pty_have = 0;
+            return queued + 1;
+        }
+    }
+}
+
+/* simulated time that has passed on the wall clock */
+static sim_time pty_clock(void)
+{
+    return (sim_time)((double)(host_ns() - pty_start) * pty_speed * SIM_BUS_HZ / 1e9);
+}
+
+int sim_wire_wait(void)
+{
+    if (pty_fd < 0)
+    {
+        return 0;
+    }
+
+    /* the device blocks here, as usbin_wait does on the PSoC */
+    while (pty_receive(1000) == 0)
+    {
+        sim_run_until(pty_clock());
+    }
+    sim_run_until(pty_clock());
+    return 1;
+}
+
+static void pty_open(void)
+{
+    struct termios tio;
+
+    pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_fd < 0 || grantpt(pty_fd) != 0 || unlockpt(pty_fd) != 0)
+    {
+        perror("pty");
+        exit(1);
+    }
+    if (tcgetattr(pty_fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(pty_fd, TCSANOW, &tio);
+    }
+    printf("device on %s\n", ptsname(pty_fd));
+    fflush(stdout);
+}
+
+static void print_isr(const struct sim_isr_stats *st)
+{
+    if (st->calls == 0)
+    {
+        return;
+    }
+    printf("%-10s %9lu calls  cycles min/avg/max %u/%llu/%u  data ready %u  host ns min/avg/max %lu/%llu/%lu\n",
+        st->name, st->calls, st->cycles_min, st->cycles_total / st->calls, st->cycles_max, st->ready_max,
+        st->ns_min, st->ns_total / st->calls, st->ns_max);
+}
+
+static void bench(long calls)
+{
+    unsigned long t0, t1, ns, ns_deferred;
+    long i;
+
+    replay_reset();
+    ring_select(2, 2, 2);
+    for (i = 0; i < RING_BYTES; i++)
+    {
+        input[i] = (uint8)i;
+    }
+    buf_ptr = ring_size - 1;
+    playing = 1;
+    hal_latch_irq_start();
+
+    t0 = host_ns();
+    for (i = 0; i < calls; i++)
+    {
+        sim_hw.isr_cycles = 0;
+        replay_latch_isr();
+    }
+    ns = host_ns() - t0;
+
+    /* each call catches up with one latch, as after every latch during
+     * playback, and the ring is topped up so it never runs dry */
+    latched = 0;
+    t1 = host_ns();
+    for (i = 0; i < calls; i++)
+    {
+        sim_hw.isr_cycles = 0;
+        buf_ptr = ring_add(input_ptr, ring_size - 1);
+        latched++;
+        replay_deferred();
+    }
+    ns_deferred = host_ns() - t1;
+
+    printf("latch ISR %.2f ns, deferred %.2f ns per call over %ld calls\n",
+        (double)ns / calls, (double)ns_deferred / calls, calls);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-c nes|snes] [-f r08|r16y|r16m] [-n frames] [-l us] [-p us] [-x latches] [-g us] [-b] [-z]\n"
+        "       [-L latch] <movie>\n"
+        "       %s -P [-S factor] [-e frames] [-c nes|snes] [-f r08|r16y|r16m] [-n frames] [-x latches] [-g us] <movie>\n"
+        "       %s -F|-H image [-b] [-z] [-c nes|snes] [-f r08|r16y|r16m] [-n frames] [-x latches] [-g us] <movie>\n"
+        "       %s -B calls\n", argv0, argv0, argv0, argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *format = "r16y";
+    const char *flash_path = NULL;
+    uint32 check = 0;
+    long limit = -1;
+    int credit_refill = 0;
+    long bench_calls = 0;
+    int pty = 0;
+    uint8 cmd[9];
+    FILE *f;
+    long size;
+    unsigned i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:f:n:l:p:x:g:bB:PS:e:F:H:zL:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                clocks_per_latch = strcmp(optarg, "snes") == 0 ? 16 : 8;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            case 'n':
+                limit = atol(optarg);
+                break;
+            case 'l':
+                host_latency = SIM_US(atol(optarg));
+                break;
+            case 'p':
+                packet_time = SIM_US(atol(optarg));
+                break;
+            case 'x':
+                latches_per_frame = atoi(optarg);
+                break;
+            case 'g':
+                latch_gap = SIM_US(atol(optarg));
+                break;
+            case 'b':
+                credit_refill = 1;
+                break;
+            case 'B':
+                bench_calls = atol(optarg);
+                break;
+            case 'P':
+                pty = 1;
+                break;
+            case 'S':
+                pty_speed = atof(optarg);
+                break;
+            case 'e':
+                blank = atol(optarg);
+                break;
+            case 'F':
+                flash_path = optarg;
+                break;
+            case 'H':
+                flash_path = optarg;
+                flash_handover = 1;
+                break;
+            case 'z':
+                rle = 1;
+                break;
+            case 'L':
+                resume = atol(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (bench_calls > 0)
+    {
+        bench(bench_calls);
+        return 0;
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+    }
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        if (strcmp(formats[i].name, format) == 0)
+        {
+            fmt = &formats[i];
+        }
+    }
+    if (fmt == NULL)
+    {
+        fprintf(stderr, "Error: unknown format \"%s\"\n", format);
+        return 1;
+    }
+    blocksize = fmt->databits * fmt->ports * fmt->lines;
+    frames_per_packet = (USBIN_PACKET_SIZE - 1) / blocksize;
+
+    f = fopen(argv[optind], "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error: \"%s\" not found\n", argv[optind]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    movie = malloc(size + fmt->stride);
+    if (movie == NULL || fread(movie, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "Error: could not read \"%s\"\n", argv[optind]);
+        return 1;
+    }
+    fclose(f);
+    movie_frames = size / fmt->stride;
+    if (limit >= 0 && limit < movie_frames)
+    {
+        movie_frames = limit;
+    }
+
+    replay_reset();
+    usbin_reset();
+
+    frame_start = SIM_US(1000);
+    next_latch = frame_start;
+
+    if (pty)
+    {
+        pty_open();
+        pty_start = host_ns();
+        while (played < movie_frames)
+        {
+            pty_receive(50);
+            sim_run_until(pty_clock());
+            replay_step();
+        }
+        goto done;
+    }
+
+    /* reset, refill mode and start, as the play scripts send them */
+    cmd[0] = 0x00;
+    sim_wire_send(cmd, 1, 0);
+    if (flash_path != NULL)
+    {
+        check = host_send_flash(flash_path, packet_time);
+    }
+    if (credit_refill)
+    {
+        cmd[0] = 0x0E;
+        cmd[1] = 0x01;
+        sim_wire_send(cmd, 2, packet_time);
+    }
+    if (flash_handover)
+    {
+        /* flash has the start, the host streams on from the frame after it */
+        cmd[0] = 0xF4;
+        cmd[1] = 0;
+        cmd[2] = check >> 24;
+        cmd[3] = check >> 16;
+        cmd[4] = check >> 8;
+        cmd[5] = check;
+        sim_wire_send(cmd, 6, 2 * packet_time);
+        movie_cursor = flash_frames < movie_frames ? flash_frames : movie_frames;
+    }
+    else if (flash_path != NULL)
+    {
+        /* the movie comes from flash, the host sends nothing after 0xF3 */
+        cmd[0] = 0xF3;
+        cmd[1] = 0;
+        sim_wire_send(cmd, 2, 2 * packet_time);
+        if (flash_frames < movie_frames)
+        {
+            /* only the opening part fitted, the rest is not on the device */
+            movie_frames = flash_frames;
+        }
+        movie_cursor = movie_frames;
+    }
+    else if (resume > 0)
+    {
+        cmd[0] = 0x02;
+        cmd[1] = fmt->databits;
+        cmd[2] = fmt->ports;
+        cmd[3] = fmt->lines;
+        cmd[4] = 0;
+        cmd[5] = resume >> 24;
+        cmd[6] = resume >> 16;
+        cmd[7] = resume >> 8;
+        cmd[8] = resume;
+        sim_wire_send(cmd, 9, 2 * packet_time);
+        movie_cursor = resume;
+    }
+    else
+    {
+        cmd[0] = 0x01;
+        cmd[1] = fmt->databits;
+        cmd[2] = fmt->ports;
+        cmd[3] = fmt->lines;
+        cmd[4] = 0;
+        sim_wire_send(cmd, 5, 2 * packet_time);
+    }
+
+    while (played + resume < movie_frames)
+    {
+        sim_run_until(sim_now + SIM_STEP_CYCLES);
+        replay_step();
+    }
+
+done:
+    printf("frames %ld  latches %d  underruns %ld  mismatches %ld  late %ld  staging misses %d  min fill %d/%d\n",
+        played, latches, underruns, mismatches, late, stage_misses, min_fill, ring_size - 1);
+    if (flash_path != NULL)
+    {
+        printf("flash image %ld frames, start answered %ld  usb requests %ld  grants %ld  packets %ld  simulated %.3f s\n",
+            flash_frames, flash_result, requests, grants, packets, (double)sim_now / SIM_BUS_HZ);
+    }
+    else if (pty)
+    {
+        printf("simulated %.3f s\n", (double)sim_now / SIM_BUS_HZ);
+    }
+    else
+    {
+        printf("usb requests %ld  grants %ld  packets %ld  simulated %.3f s\n",
+            requests, grants, packets, (double)sim_now / SIM_BUS_HZ);
+    }
+    print_isr(&latch_stats);
+    print_isr(&dma_stats);
+    print_isr(&joybus_stats);
+    print_isr(&timer_stats);
+    print_isr(&autolatch_stats);
+    print_isr(&deferred_stats);
+
+    if (flash_path != NULL && (flash_result != 0 || (!flash_handover && (requests || grants))))
+    {
+        return 2;
+    }
+    return (underruns || mismatches) ? 2 : 0;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,74 @@
+/* ========================================
+ * Host simulator for the replay core
+ * ========================================
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <main.h>
+
+/* simulated time is counted in PSoC bus clock cycles */
+typedef unsigned long long sim_time;
+
+#define SIM_BUS_HZ     72000000ULL
+#define SIM_WINDOW_HZ  24000000ULL
+
+#define SIM_US(us) ((sim_time)(us) * (SIM_BUS_HZ / 1000000ULL))
+
+/* Cortex-M3 exception entry/exit and a UDB register write over the PHUB */
+#define SIM_ISR_ENTRY_CYCLES  12
+#define SIM_ISR_EXIT_CYCLES   10
+#define SIM_REG_WRITE_CYCLES   6
+
+/* a TD of the latch DMA chain: PHUB arbitration, TD fetch and one 16-bit
+ * spoke write, an estimate */
+#define SIM_DMA_TD_CYCLES      8
+
+/* one pass of the main loop without packet work */
+#define SIM_STEP_CYCLES      200
+
+struct sim_hw
+{
+    uint16 regs[4];
+    int latch_irq;
+    /* latch DMA running, its two source slots and the one it copies next */
+    int latch_dma;
+    const volatile uint16 *dma_slot[2];
+    int dma_next;
+    /* joybus component answering polls, as a GameCube pad, and the frame
+     * in its FIFOs until a poll takes it */
+    int joybus;
+    int joybus_gc;
+    uint16 joybus_fifo[4];
+    int joybus_staged;
+    int autolatch;
+    int autolatch_count;
+    int autolatch_period;
+    int autolatch_port;
+    uint16 window_period[2];
+    uint8 clock_filter_period[2];
+
+    /* cycles charged to the running ISR, and when its shift registers were loaded */
+    unsigned isr_cycles;
+    unsigned isr_ready;
+
+    /* PendSV requested through hal_defer */
+    int defer_pending;
+};
+
+extern struct sim_hw sim_hw;
+extern sim_time sim_now;
+
+/* sim.c */
+void sim_run_until(sim_time t);
+void sim_host_rx(const uint8 *buf, int len);
+int sim_wire_wait(void);
+
+/* hal_host.c */
+void sim_wire_send(const uint8 *buf, int len, sim_time due);
+sim_time sim_wire_next_due(void);
+sim_time sim_wire_last_due(void);
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,236 @@
+// ========================================
+//
+// Stand-in for PSoC Creator's cypress.v, so that
+// joybus.v simulates with Icarus (make joybus).
+//
+// The datapath configuration macros are field codes
+// of this file's own, one nibble each for the
+// CFGRAM fields and one bit for the static ones,
+// and cy_psoc3_dp below is a behavioural datapath
+// that decodes them. It models what joybus.v uses:
+// ALU pass from A0 or A1, shift left with 0 in and
+// so out, accumulator loads from the ALU or their
+// FIFO, and F0/F1 written by the CPU, which the
+// bench does through push0, push1 and clear. Any
+// other operation in a CFGRAM word is reported.
+//
+// This checks which operation each cs_addr selects,
+// not Cypress's bit encoding of it; PSoC Creator's
+// build checks that.
+//
+// ========================================
+
+`define CS_ALU_OP_PASS    4'h1
+`define CS_SRCA_A0        4'h0
+`define CS_SRCA_A1        4'h1
+`define CS_SRCB_D0        4'h0
+`define CS_SHFT_OP_PASS   4'h0
+`define CS_SHFT_OP___SL   4'h1
+`define CS_A0_SRC_NONE    4'h0
+`define CS_A0_SRC__ALU    4'h1
+`define CS_A0_SRC___F0    4'h2
+`define CS_A1_SRC_NONE    4'h0
+`define CS_A1_SRC__ALU    4'h1
+`define CS_A1_SRC___F1    4'h2
+`define CS_FEEDBACK_DSBL  4'h0
+`define CS_CI_SEL_CFGA    4'h0
+`define CS_SI_SEL_CFGA    4'h0
+`define CS_CMP_SEL_CFGA   4'h0
+
+`define SC_CMPB_A1_D1     1'b0
+`define SC_CMPA_A1_D1     1'b0
+`define SC_CI_B_ARITH     1'b0
+`define SC_CI_A_ARITH     1'b0
+`define SC_C1_MASK_DSBL   1'b0
+`define SC_C0_MASK_DSBL   1'b0
+`define SC_A_MASK_DSBL    1'b0
+`define SC_DEF_SI_0       1'b0
+`define SC_SI_B_DEFSI     1'b0
+`define SC_SI_A_DEFSI     1'b0
+`define SC_A0_SRC_ACC     1'b0
+`define SC_SHIFT_SL       1'b0
+`define SC_FIFO1_BUS      1'b0
+`define SC_FIFO0_BUS      1'b0
+`define SC_MSB_DSBL       1'b0
+`define SC_MSB_BIT0       1'b0
+`define SC_MSB_NOCHN      1'b0
+`define SC_FB_NOCHN       1'b0
+`define SC_CMP1_NOCHN     1'b0
+`define SC_CMP0_NOCHN     1'b0
+`define SC_FIFO_CLK__DP   1'b0
+`define SC_FIFO_CAP_AX    1'b0
+`define SC_FIFO_LEVEL     1'b0
+`define SC_FIFO__SYNC     1'b0
+`define SC_EXTCRC_DSBL    1'b0
+`define SC_WRK16CAT_DSBL  1'b0
+
+module cy_psoc3_dp (
+	input   reset,
+	input   clk,
+	input  [2:0] cs_addr,
+	input   route_si,
+	input   route_ci,
+	input   f0_load,
+	input   f1_load,
+	input   d0_load,
+	input   d1_load,
+	output  ce0,
+	output  cl0,
+	output  z0,
+	output  ff0,
+	output  ce1,
+	output  cl1,
+	output  z1,
+	output  ff1,
+	output  ov_msb,
+	output  co_msb,
+	output  cmsb,
+	output  so,
+	output  f0_bus_stat,
+	output  f0_blk_stat,
+	output  f1_bus_stat,
+	output  f1_blk_stat
+);
+    parameter cy_dpconfig = 0;
+
+    /* eight 40 bit CFGRAM words, then the static part: 44 bits of literals
+     * and 26 one bit macros */
+    localparam TAIL = 70;
+    localparam [8 * 40 + TAIL - 1:0] CFG = cy_dpconfig;
+
+    reg [39:0] cfgram [0:7];
+    reg [7:0] a0;
+    reg [7:0] a1;
+    reg [7:0] f0 [0:3];
+    reg [7:0] f1 [0:3];
+    integer f0_n;
+    integer f1_n;
+    /* loads from an empty FIFO, writes to a full one, unmodelled operations */
+    integer errors;
+    integer k;
+
+    wire [39:0] w = cfgram[cs_addr];
+    wire [7:0] alu = (w[35:32] == 4'h1) ? a1 : a0;
+    wire shl = (w[27:24] == 4'h1);
+    wire [7:0] shifted = shl ? {alu[6:0], 1'b0} : alu;
+
+    assign so = shl ? alu[7] : 1'b0;
+    assign f0_bus_stat = (f0_n < 4);
+    assign f0_blk_stat = (f0_n == 0);
+    assign f1_bus_stat = (f1_n < 4);
+    assign f1_blk_stat = (f1_n == 0);
+    assign {ce0, cl0, z0, ff0, ce1, cl1, z1, ff1, ov_msb, co_msb, cmsb} = 11'b0;
+
+    task push0(input [7:0] b);
+        begin
+            if(f0_n == 4)
+            begin
+                $display("cy_psoc3_dp: F0 written while full");
+                errors = errors + 1;
+            end
+            else
+            begin
+                f0[f0_n] = b;
+                f0_n = f0_n + 1;
+            end
+        end
+    endtask
+
+    task push1(input [7:0] b);
+        begin
+            if(f1_n == 4)
+            begin
+                $display("cy_psoc3_dp: F1 written while full");
+                errors = errors + 1;
+            end
+            else
+            begin
+                f1[f1_n] = b;
+                f1_n = f1_n + 1;
+            end
+        end
+    endtask
+
+    /* FIFO0_CLR and FIFO1_CLR in the auxiliary control register */
+    task clear;
+        begin
+            f0_n = 0;
+            f1_n = 0;
+        end
+    endtask
+
+    always @ (posedge clk)
+    begin
+        if(w[39:36] != 4'h1 || w[31:28] != 4'h0 || w[15:0] != 16'h0)
+        begin
+            $display("cy_psoc3_dp: CFGRAM%0d is not modelled", cs_addr);
+            errors = errors + 1;
+        end
+
+        case(w[23:20])
+            4'h0: ;
+            4'h1: a0 <= shifted;
+            4'h2:
+                begin
+                    if(f0_n == 0)
+                    begin
+                        $display("cy_psoc3_dp: A0 loaded from an empty F0");
+                        errors = errors + 1;
+                    end
+                    else
+                    begin
+                        a0 <= f0[0];
+                        for(k = 0; k < 3; k = k + 1)
+                        begin
+                            f0[k] = f0[k + 1];
+                        end
+                        f0_n = f0_n - 1;
+                    end
+                end
+            default:
+                begin
+                    $display("cy_psoc3_dp: A0 source %0d is not modelled", w[23:20]);
+                    errors = errors + 1;
+                end
+        endcase
+
+        case(w[19:16])
+            4'h0: ;
+            4'h1: a1 <= shifted;
+            4'h2:
+                begin
+                    if(f1_n == 0)
+                    begin
+                        $display("cy_psoc3_dp: A1 loaded from an empty F1");
+                        errors = errors + 1;
+                    end
+                    else
+                    begin
+                        a1 <= f1[0];
+                        for(k = 0; k < 3; k = k + 1)
+                        begin
+                            f1[k] = f1[k + 1];
+                        end
+                        f1_n = f1_n - 1;
+                    end
+                end
+            default:
+                begin
+                    $display("cy_psoc3_dp: A1 source %0d is not modelled", w[19:16]);
+                    errors = errors + 1;
+                end
+        endcase
+    end
+
+    initial begin
+        for(k = 0; k < 8; k = k + 1)
+        begin
+            cfgram[k] = CFG >> (TAIL + 40 * (7 - k));
+        end
+        a0 = 0;
+        a1 = 0;
+        f0_n = 0;
+        f1_n = 0;
+        errors = 0;
+    end
+endmodule
@@ -0,0 +1,283 @@
+// ========================================
+//
+// joybus.v against a console model
+//
+// The console sends commands on the shared line
+// bit by bit as an N64 or GameCube does, and every
+// response is decoded from the line and checked:
+// the bytes of 0x00 and 0x41 in both modes and of
+// 0x01 and 0x40 from frames staged into the FIFOs
+// the way joybus.c does, the low time of each bit,
+// the 4 us bit cell and 2 us stop bit, the delay
+// before the answer, one poll pulse per answered
+// poll and none otherwise, and silence for
+// commands that are not answered.
+//
+// Run with make joybus, which needs Icarus Verilog:
+//   iverilog -g2005 -I test/joybus -o test/joybus_tb \
+//       test/joybus/joybus_tb.v ../TASBot.cydsn/joybus/joybus.v
+//   vvp test/joybus_tb
+//
+// ========================================
+`timescale 1ns / 1ps
+
+module joybus_tb;
+    localparam CLOCKS_PER_US = 8;
+    localparam CLOCK_NS = 1000.0 / CLOCKS_PER_US;
+
+    reg clk = 0;
+    reg gc = 0;
+    reg console_low = 0;
+    wire line_out;
+    wire poll;
+    wire busy;
+
+    /* open drain with a pull-up: low while either side pulls it down */
+    wire line = ~console_low & line_out;
+
+    joybus #(.CLOCKS_PER_US(CLOCKS_PER_US)) dut (
+        .line_out(line_out),
+        .poll(poll),
+        .busy(busy),
+        .clk(clk),
+        .line_in(line),
+        .gc(gc)
+    );
+
+    always #(CLOCK_NS / 2) clk = ~clk;
+
+    integer failed = 0;
+    integer polls = 0;
+
+    always @ (posedge clk)
+    begin
+        if(poll)
+        begin
+            polls = polls + 1;
+        end
+    end
+
+    /* the console side */
+
+    task send_bit(input b);
+        begin
+            console_low = 1;
+            #(b ? 1000 : 3000);
+            console_low = 0;
+            #(b ? 3000 : 1000);
+        end
+    endtask
+
+    task send_byte(input [7:0] b);
+        integer i;
+        begin
+            for(i = 7; i >= 0; i = i - 1)
+            begin
+                send_bit(b[i]);
+            end
+        end
+    endtask
+
+    /* the stop bit is a 1 us low, after it the line is left to the pad */
+    task send_stop;
+        begin
+            console_low = 1;
+            #1000;
+            console_low = 0;
+        end
+    endtask
+
+    /* decoded response */
+    reg [79:0] rx;
+    integer rx_bits;
+
+    function near(input real a, input real b);
+        near = (a - b < 1.0) && (b - a < 1.0);
+    endfunction
+
+    /* Read the answer to a command whose stop bit just ended: rx_bits is
+     * -1 if the line stays high, else the bits before the stop bit, with
+     * the last of them in rx[0]. */
+    task receive;
+        real released, fall, prev, low;
+        reg done;
+        begin
+            released = $realtime;
+            rx = 0;
+            rx_bits = -1;
+            done = 0;
+
+            fork : wait_first
+                begin
+                    @(negedge line);
+                    disable wait_first;
+                end
+                begin
+                    #20000;
+                    disable wait_first;
+                end
+            join
+
+            if(line === 1'b0)
+            begin
+                rx_bits = 0;
+                fall = $realtime;
+                /* the line is high for 4 us, then the synchronizer and the
+                 * registered drive take a few clocks */
+                if(fall - released < 4000.0 || fall - released > 4000.0 + 8 * CLOCK_NS)
+                begin
+                    $display("answer %0.0f ns after the stop bit", fall - released);
+                    failed = failed + 1;
+                end
+            end
+
+            while(rx_bits >= 0 && !done)
+            begin
+                @(posedge line);
+                low = $realtime - fall;
+                if(near(low, 2000.0))
+                begin
+                    done = 1;
+                end
+                else if(near(low, 1000.0) || near(low, 3000.0))
+                begin
+                    rx = {rx[78:0], near(low, 1000.0)};
+                    rx_bits = rx_bits + 1;
+                end
+                else
+                begin
+                    $display("bit %0d low for %0.0f ns", rx_bits, low);
+                    failed = failed + 1;
+                    done = 1;
+                end
+
+                if(!done)
+                begin
+                    prev = fall;
+                    fork : wait_next
+                        begin
+                            @(negedge line);
+                            disable wait_next;
+                        end
+                        begin
+                            #10000;
+                            disable wait_next;
+                        end
+                    join
+                    if(line !== 1'b0)
+                    begin
+                        $display("no stop bit after %0d bits", rx_bits);
+                        failed = failed + 1;
+                        done = 1;
+                    end
+                    else
+                    begin
+                        fall = $realtime;
+                        if(!near(fall - prev, 4000.0))
+                        begin
+                            $display("bit cell %0d is %0.0f ns", rx_bits, fall - prev);
+                            failed = failed + 1;
+                        end
+                    end
+                end
+            end
+
+            /* the pad is done with the line */
+            #1000;
+            if(busy)
+            begin
+                $display("still busy after the stop bit");
+                failed = failed + 1;
+            end
+        end
+    endtask
+
+    /* stage a frame the way joybus_stage does: bytes 0 to 3 to F0, 4 to 7 to F1 */
+    task stage(input [63:0] frame);
+        integer k;
+        begin
+            dut.dp.clear;
+            for(k = 0; k < 4; k = k + 1)
+            begin
+                dut.dp.push0(frame[63 - 8 * k -: 8]);
+            end
+            for(k = 0; k < 4; k = k + 1)
+            begin
+                dut.dp.push1(frame[31 - 8 * k -: 8]);
+            end
+        end
+    endtask
+
+    /* send a command of bytes bytes from cmd (first byte highest) and check
+     * the answer is bits bits of want, or nothing if bits is -1, and that
+     * it pulsed poll as often as a poll does */
+    task check(input [8*80-1:0] name, input [23:0] cmd, input integer bytes,
+               input integer bits, input [79:0] want, input integer want_polls);
+        integer i;
+        integer polls_before;
+        reg [79:0] mask;
+        begin
+            polls_before = polls;
+            for(i = 0; i < bytes; i = i + 1)
+            begin
+                send_byte(cmd[23 - 8 * i -: 8]);
+            end
+            send_stop;
+            receive;
+
+            mask = (bits >= 80) ? {80{1'b1}} : (bits > 0) ? ((80'b1 << bits) - 1) : 80'b0;
+            if(rx_bits != bits || (rx & mask) != (want & mask))
+            begin
+                $display("%0s: %0d bits %h, wanted %0d bits %h", name, rx_bits, rx & mask, bits, want & mask);
+                failed = failed + 1;
+            end
+            if(polls - polls_before != want_polls)
+            begin
+                $display("%0s: %0d poll pulses, wanted %0d", name, polls - polls_before, want_polls);
+                failed = failed + 1;
+            end
+
+            /* the console's next command comes a while later */
+            #50000;
+        end
+    endtask
+
+    initial begin
+        #10000;
+
+        /* N64 */
+        gc = 0;
+        stage(64'h8142_7F80_0000_0000);
+        check("N64 identity", 24'h00_0000, 1, 24, 80'h050002, 0);
+        check("N64 reset", 24'hFF_0000, 1, 24, 80'h050002, 0);
+        check("N64 poll", 24'h01_0000, 1, 32, 80'h81427F80, 1);
+        /* the CPU stages the next frame after the poll pulse */
+        stage(64'h0010_2030_0000_0000);
+        check("N64 poll, next frame", 24'h01_0000, 1, 32, 80'h00102030, 1);
+        stage(64'hFFFF_FFFF_0000_0000);
+        check("N64 poll, all ones", 24'h01_0000, 1, 32, 80'hFFFFFFFF, 1);
+        check("N64 pak read", 24'h02_0000, 1, -1, 80'h0, 0);
+        check("GameCube origin on an N64", 24'h41_0000, 1, -1, 80'h0, 0);
+
+        /* GameCube */
+        gc = 1;
+        stage(64'h0180_8080_8080_1F20);
+        check("GameCube identity", 24'h00_0000, 1, 24, 80'h090003, 0);
+        check("GameCube origin", 24'h41_0000, 1, 80, 80'h00808080808000000000, 0);
+        check("GameCube recalibrate", 24'h42_0000, 1, 80, 80'h00808080808000000000, 0);
+        check("GameCube poll", 24'h40_0300, 3, 64, 80'h01808080_80801F20, 1);
+        stage(64'h1234_5678_9ABC_DEF0);
+        check("GameCube poll, next frame", 24'h40_0300, 3, 64, 80'h12345678_9ABCDEF0, 1);
+        check("N64 poll on a GameCube", 24'h01_0000, 1, -1, 80'h0, 0);
+        check("GameCube poll cut short", 24'h40_0000, 1, -1, 80'h0, 0);
+
+        if(dut.dp.errors != 0)
+        begin
+            $display("%0d datapath errors", dut.dp.errors);
+            failed = failed + 1;
+        end
+
+        $display("joybus: %0s", failed ? "FAIL" : "ok");
+        $finish;
+    end
+endmodule
@@ -0,0 +1,186 @@
+/* ========================================
+ * ring.h under two threads
+ *
+ * The main thread plays the main loop, writing
+ * frames a byte at a time as decode does and
+ * publishing them in bursts; a second thread plays
+ * the latch path, advancing one or a few frames at
+ * a time as replay_deferred catches up with
+ * latches. Each frame carries its number and a
+ * checksum over it, so a frame read before it was
+ * all written, or one read twice or skipped, is
+ * caught. The simulator runs the ISRs on the one
+ * thread and never gets to see this.
+ *
+ * On x86 the hardware keeps stores in order by
+ * itself, so only the compiler side of hal_dmb is
+ * really under test there; on an ARM host it is
+ * the barrier as well. The producer also yields
+ * in the middle of frames now and then, so the
+ * threads interleave there even on one core.
+ *
+ * Build (or make test):
+ *   gcc -O2 -pthread -DTASBOT_HOST -I../TASBot.cydsn -o test/ring_stress_test \
+ *       test/ring_stress_test.c
+ *
+ * Usage:
+ *   ring_stress_test [frames]
+ * ========================================
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ring.h>
+
+/* what replay.c defines */
+volatile uint8 input[RING_BYTES];
+volatile int input_ptr = 0;
+volatile int buf_ptr = 0;
+volatile int ring_size = 0;
+volatile int ring_shift = 0;
+int ring_tail_seen = 0;
+int ring_head_seen = 0;
+volatile int ring_underruns = 0;
+int ring_dropped = 0;
+
+static uint32 frames = 20000000;
+static volatile int failed = 0;
+
+/* 8 byte frames: the number, then a checksum of it */
+static uint32 frame_check(uint32 seq)
+{
+    return (seq * 2654435761u) ^ 0xA5A5A5A5u;
+}
+
+static void put32(uint8 *p, uint32 v)
+{
+    p[0] = (uint8)v;
+    p[1] = (uint8)(v >> 8);
+    p[2] = (uint8)(v >> 16);
+    p[3] = (uint8)(v >> 24);
+}
+
+static uint32 get32(const uint8 *p)
+{
+    return (uint32)p[0] | ((uint32)p[1] << 8) | ((uint32)p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+/* the latch path */
+static void *consumer(void *arg)
+{
+    uint32 want = 0;
+    uint32 seq;
+    uint32 rng = 7;
+    int from, ptr, step;
+    const uint8 *f;
+
+    (void) arg;
+
+    while(want < frames - 1 && !failed)
+    {
+        rng = rng * 1103515245u + 12345u;
+        step = ((rng >> 16) % 8 == 0) ? 1 + (rng >> 20) % 4 : 1;
+
+        from = input_ptr;
+        ptr = ring_advance(step);
+        if(ptr == from)
+        {
+            /* ran dry, as a latch before the host caught up would */
+            ring_underruns = 0;
+            sched_yield();
+            continue;
+        }
+        want += ring_distance(from, ptr);
+
+        f = ring_frame(ptr);
+        seq = get32(f);
+        if(seq != want || get32(f + 4) != frame_check(seq))
+        {
+            fprintf(stderr, "frame at %d: number %u check %08x, wanted %u check %08x\n",
+                    ptr, seq, get32(f + 4), want, frame_check(want));
+            failed = 1;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t thread;
+    uint32 seq = 0;
+    uint32 rng = 3;
+    uint8 frame[8];
+    int ptr, room, n, i, size;
+
+    if(argc > 1)
+    {
+        frames = (uint32) strtoul(argv[1], NULL, 0);
+    }
+
+    /* 8 byte frames, one short of ring_select's size so it is not even */
+    ring_shift = 3;
+    ring_size = (RING_BYTES >> 3) - 1;
+    size = ring_size;
+
+    /* frame 0 is there before the first latch, as replay_begin has it */
+    put32((uint8 *)ring_frame(0), 0);
+    put32((uint8 *)ring_frame(0) + 4, frame_check(0));
+    seq = 1;
+    ring_publish(1);
+
+    if(pthread_create(&thread, NULL, consumer, NULL) != 0)
+    {
+        perror("pthread_create");
+        return 1;
+    }
+
+    while(seq < frames && !failed)
+    {
+        rng = rng * 1103515245u + 12345u;
+        n = 1 + (rng >> 16) % 64;
+        room = ring_writable(n);
+        if(room == 0)
+        {
+            sched_yield();
+            continue;
+        }
+        if(n > room)
+        {
+            n = room;
+        }
+        if(n > (int)(frames - seq))
+        {
+            n = (int)(frames - seq);
+        }
+
+        ptr = buf_ptr;
+        while(n-- > 0)
+        {
+            put32(frame, seq);
+            put32(frame + 4, frame_check(seq));
+            for(i = 0; i < 8; i++)
+            {
+                ring_frame(ptr)[i] = frame[i];
+
+                /* now and then the latch comes in the middle of a frame */
+                rng = rng * 1103515245u + 12345u;
+                if((rng >> 16) % 256 == 0)
+                {
+                    sched_yield();
+                }
+            }
+            seq++;
+            ptr = ring_next(ptr);
+        }
+        ring_publish(ptr);
+    }
+
+    pthread_join(thread, NULL);
+
+    printf("ring stress: %u frames through %d slots: %s\n", seq, size, failed ? "FAIL" : "ok");
+    return failed;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,289 @@
+/* ========================================
+ * ring.h index arithmetic
+ *
+ * The empty, full and wrap edges of the replay
+ * ring and the drop of a 0xD1 resync, for ring
+ * sizes that are not a power of two and for the
+ * sizes ring_select picks, driven directly
+ * instead of through a simulated run, which in
+ * request mode never fills the ring.
+ *
+ * Build (or make test):
+ *   gcc -O2 -DTASBOT_HOST -I../TASBot.cydsn -o test/ring_test test/ring_test.c
+ * ========================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ring.h>
+
+/* what replay.c defines */
+volatile uint8 input[RING_BYTES];
+volatile int input_ptr = 0;
+volatile int buf_ptr = 0;
+volatile int ring_size = 0;
+volatile int ring_shift = 0;
+int ring_tail_seen = 0;
+int ring_head_seen = 0;
+volatile int ring_underruns = 0;
+int ring_dropped = 0;
+
+static int failed = 0;
+
+#define CHECK(cond, ...) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: ", __func__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failed = 1; \
+            return; \
+        } \
+    } while(0)
+
+static void ring_init(int size, int shift)
+{
+    ring_size = size;
+    ring_shift = shift;
+    input_ptr = 0;
+    buf_ptr = 0;
+    ring_tail_seen = 0;
+    ring_head_seen = 0;
+    ring_underruns = 0;
+    ring_dropped = 0;
+}
+
+/* frames are numbered in as many low bytes as they are wide */
+static uint32 frame_mask(void)
+{
+    return (ring_shift >= 2) ? 0xFFFFFFFFu : (1u << (8 << ring_shift)) - 1;
+}
+
+/* producer: write and publish n frames numbered on from *seq */
+static void produce(int n, uint32 *seq)
+{
+    int ptr = buf_ptr;
+    int i;
+
+    while(n-- > 0)
+    {
+        for(i = 0; i < (1 << ring_shift) && i < 4; i++)
+        {
+            ring_frame(ptr)[i] = (uint8)(*seq >> (8 * i));
+        }
+        (*seq)++;
+        ptr = ring_next(ptr);
+    }
+    ring_publish(ptr);
+}
+
+static uint32 frame_seq(int ptr)
+{
+    uint32 seq = 0;
+    int i;
+
+    for(i = 0; i < (1 << ring_shift) && i < 4; i++)
+    {
+        seq |= (uint32)ring_frame(ptr)[i] << (8 * i);
+    }
+    return seq;
+}
+
+static void test_positions(void)
+{
+    ring_init(7, 3);
+
+    CHECK(ring_next(5) == 6, "next(5) is %d", ring_next(5));
+    CHECK(ring_next(6) == 0, "next(6) is %d", ring_next(6));
+    CHECK(ring_add(5, 2) == 0, "add(5, 2) is %d", ring_add(5, 2));
+    CHECK(ring_add(5, 3) == 1, "add(5, 3) is %d", ring_add(5, 3));
+    CHECK(ring_add(0, 7) == 0, "add(0, 7) is %d", ring_add(0, 7));
+    CHECK(ring_add(6, 7) == 6, "add(6, 7) is %d", ring_add(6, 7));
+    CHECK(ring_distance(2, 2) == 0, "distance(2, 2) is %d", ring_distance(2, 2));
+    CHECK(ring_distance(2, 5) == 3, "distance(2, 5) is %d", ring_distance(2, 5));
+    CHECK(ring_distance(5, 1) == 3, "distance(5, 1) is %d", ring_distance(5, 1));
+    CHECK(ring_distance(6, 0) == 1, "distance(6, 0) is %d", ring_distance(6, 0));
+    CHECK(ring_frame(6) == (uint8 *)&input[48], "frame 6 at %d", (int)(ring_frame(6) - (uint8 *)input));
+}
+
+static void test_empty(void)
+{
+    ring_init(7, 3);
+
+    CHECK(ring_fill() == 0, "fill %d", ring_fill());
+    CHECK(ring_free() == 6, "free %d", ring_free());
+    CHECK(ring_writable(6) == 6, "writable %d", ring_writable(6));
+
+    /* nothing published: the consumer stays and counts the frame it missed */
+    CHECK(ring_advance(1) == 0, "advanced to %d", input_ptr);
+    CHECK(ring_underruns == 1, "underruns %d", ring_underruns);
+
+    /* the current frame is the consumer's, one more is needed to move on */
+    ring_underruns = 0;
+    ring_publish(1);
+    CHECK(ring_advance(1) == 0, "advanced past the last frame to %d", input_ptr);
+    CHECK(ring_underruns == 1, "underruns %d", ring_underruns);
+    ring_publish(2);
+    CHECK(ring_advance(1) == 1, "advanced to %d", input_ptr);
+    CHECK(ring_underruns == 1, "underruns %d", ring_underruns);
+
+    /* empty again at the end of the ring, then across the wrap */
+    ring_init(7, 3);
+    input_ptr = buf_ptr = ring_head_seen = ring_tail_seen = 6;
+    CHECK(ring_fill() == 0, "fill at the end %d", ring_fill());
+    ring_publish(1);
+    CHECK(ring_fill() == 2, "fill across the wrap %d", ring_fill());
+    CHECK(ring_advance(1) == 0, "advanced to %d", input_ptr);
+    CHECK(ring_advance(1) == 0, "advanced past the last frame to %d", input_ptr);
+    CHECK(ring_underruns == 1, "underruns %d", ring_underruns);
+}
+
+static void test_full(void)
+{
+    uint32 seq = 0;
+
+    ring_init(7, 3);
+    produce(6, &seq);
+
+    CHECK(ring_fill() == 6, "fill %d", ring_fill());
+    CHECK(ring_free() == 0, "free %d", ring_free());
+    CHECK(ring_writable(1) == 0, "writable %d", ring_writable(1));
+    CHECK(buf_ptr == 6 && input_ptr == 0, "buf_ptr %d input_ptr %d", buf_ptr, input_ptr);
+
+    /* the producer's copy of input_ptr is stale until it runs short */
+    ring_advance(2);
+    CHECK(ring_tail_seen == 0, "tail seen %d", ring_tail_seen);
+    CHECK(ring_writable(2) == 2, "writable %d", ring_writable(2));
+    CHECK(ring_tail_seen == 2, "tail seen %d", ring_tail_seen);
+
+    /* full again with buf_ptr wrapped behind input_ptr */
+    produce(2, &seq);
+    CHECK(buf_ptr == 1, "buf_ptr %d", buf_ptr);
+    CHECK(ring_free() == 0, "free %d", ring_free());
+    CHECK(ring_writable(1) == 0, "writable %d", ring_writable(1));
+
+    /* the consumer drains it all, in order, and no further */
+    CHECK(frame_seq(input_ptr) == 2, "frame %u", frame_seq(input_ptr));
+    for(seq = 3; seq < 8; seq++)
+    {
+        ring_advance(1);
+        CHECK(frame_seq(input_ptr) == seq, "frame %u at %d, wanted %u", frame_seq(input_ptr), input_ptr, seq);
+    }
+    CHECK(input_ptr == 0 && ring_underruns == 0, "drained to %d, underruns %d", input_ptr, ring_underruns);
+    CHECK(ring_fill() == 1, "fill %d", ring_fill());
+    ring_advance(1);
+    CHECK(ring_underruns == 1 && input_ptr == 0, "underruns %d at %d", ring_underruns, input_ptr);
+    CHECK(ring_writable(6) == 5, "writable %d", ring_writable(6));
+}
+
+static void test_clamp(void)
+{
+    uint32 seq = 0;
+
+    ring_init(7, 3);
+    produce(4, &seq);
+
+    /* frames 1 to 3 are ahead, asking for 5 stops on the last one */
+    CHECK(ring_advance(5) == 3, "advanced to %d", input_ptr);
+    CHECK(ring_underruns == 2, "underruns %d", ring_underruns);
+    CHECK(frame_seq(3) == 3, "frame %u", frame_seq(3));
+}
+
+/* 0xD1: everything queued is dropped and the next frame taken is the first
+ * one written after it, here across the wrap */
+static void test_drop(void)
+{
+    uint32 seq = 0;
+
+    ring_init(7, 3);
+    produce(5, &seq);
+    ring_advance(1);
+
+    ring_drop();
+    CHECK(input_ptr == 5 && ring_fill() == 0, "dropped to %d, fill %d", input_ptr, ring_fill());
+    CHECK(ring_free() == 6, "free %d", ring_free());
+
+    /* nothing written since: no frame to take and no underrun */
+    CHECK(ring_advance(1) == -1, "advanced to %d", input_ptr);
+    CHECK(ring_advance(2) == -1, "advanced to %d", input_ptr);
+    CHECK(ring_underruns == 0, "underruns %d", ring_underruns);
+
+    /* frames 5 and 6, then 7 at the start of the ring */
+    produce(2, &seq);
+    CHECK(ring_advance(1) == 5 && frame_seq(5) == 5, "took frame %u at %d", frame_seq(input_ptr), input_ptr);
+    CHECK(ring_advance(1) == 6 && frame_seq(6) == 6, "took frame %u at %d", frame_seq(input_ptr), input_ptr);
+    CHECK(ring_underruns == 0, "underruns %d", ring_underruns);
+
+    /* out of frames again, this time it is an underrun */
+    CHECK(ring_advance(1) == 6, "advanced to %d", input_ptr);
+    CHECK(ring_underruns == 1, "underruns %d", ring_underruns);
+    produce(1, &seq);
+    CHECK(ring_advance(1) == 0 && frame_seq(0) == 7, "took frame %u at %d", frame_seq(input_ptr), input_ptr);
+
+    /* two latches came before the drop's first frame was staged: the second
+     * takes the frame after it */
+    produce(4, &seq);
+    ring_drop();
+    produce(3, &seq);
+    CHECK(ring_advance(2) == 6 && frame_seq(6) == 13, "took frame %u at %d", frame_seq(input_ptr), input_ptr);
+    CHECK(ring_underruns == 1, "underruns %d", ring_underruns);
+}
+
+/* many wraps at every size ring_select picks and at awkward small ones,
+ * with the producer and consumer in varying steps */
+static void test_wrap(int size, int shift)
+{
+    uint32 seq = 0;
+    uint32 want = 0;
+    int step, room, n, k;
+
+    ring_init(size, shift);
+    produce(1, &seq);
+
+    for(step = 0; step < 8 * size + 1000; step++)
+    {
+        room = ring_writable(1 + step % 13);
+        n = step % 17 < room ? step % 17 : room;
+        produce(n, &seq);
+        CHECK(ring_fill() <= size - 1 && ring_fill() >= 1, "size %d: fill %d", size, ring_fill());
+        CHECK(buf_ptr >= 0 && buf_ptr < size, "size %d: buf_ptr %d", size, buf_ptr);
+
+        k = 1 + step % 11;
+        if(k > ring_fill() - 1)
+        {
+            k = ring_fill() - 1;
+        }
+        ring_advance(k);
+        want += k;
+        CHECK(input_ptr >= 0 && input_ptr < size, "size %d: input_ptr %d", size, input_ptr);
+        CHECK(frame_seq(input_ptr) == (want & frame_mask()), "size %d: frame %u, wanted %u",
+              size, frame_seq(input_ptr), want & frame_mask());
+    }
+    CHECK(ring_underruns == 0, "size %d: underruns %d", size, ring_underruns);
+    CHECK(seq > (uint32)(4 * size), "size %d: only %u frames through", size, seq);
+}
+
+int main(void)
+{
+    int shift;
+
+    test_positions();
+    test_empty();
+    test_full();
+    test_clamp();
+    test_drop();
+    test_wrap(3, 3);
+    test_wrap(7, 3);
+    test_wrap(1000, 2);
+    for(shift = 0; shift <= 3; shift++)
+    {
+        test_wrap(RING_BYTES >> shift, shift);
+    }
+
+    printf("ring: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,317 @@
+/* ========================================
+ * The streamer's 0x10 packets through the
+ * firmware's expander
+ *
+ * Frames are packed by wire_packer (Streamer/
+ * rle.cpp), as tasbot_stream -z sends them, and
+ * every packet is expanded by rle_open and
+ * rle_expand (TASBot.cydsn/decode.c) the way
+ * replay.c's wire_open and wire_expand do, with
+ * the frame before the packet kept from the last
+ * one. Each frame that comes out of the ring has
+ * to be the movie's frame, bit for bit.
+ *
+ * The movies are random frames, runs of every
+ * length around the 128 frame token edge, a run
+ * long enough for packets to stop at 1024 frames
+ * and a mix of both, in every layout with two or
+ * fewer lines, in one with a skipped third line,
+ * and in a ring too small to hold a packet.
+ *
+ * Build (or make test):
+ *   gcc -O2 -DTASBOT_HOST -I../TASBot.cydsn -c -o test/decode.o ../TASBot.cydsn/decode.c
+ *   g++ -O2 -std=c++17 -DTASBOT_HOST -I../TASBot.cydsn -I../Streamer -o test/rle_test \
+ *       test/rle_test.cpp ../Streamer/rle.cpp test/decode.o
+ * ========================================
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "rle.h"
+
+extern "C"
+{
+#include <main.h>
+#include <decode.h>
+}
+
+/* what replay.c defines */
+volatile uint8 input[RING_BYTES];
+volatile int input_ptr = 0;
+volatile int buf_ptr = 0;
+volatile int ring_size = 0;
+volatile int ring_shift = 0;
+int ring_tail_seen = 0;
+int ring_head_seen = 0;
+volatile int ring_underruns = 0;
+int ring_dropped = 0;
+volatile fetch_fn ring_unpack;
+
+namespace
+{
+
+struct layout_case
+{
+    int databits;
+    int ports;
+    int lines;
+};
+
+const layout_case layouts[] = {
+    { 1, 1, 1 }, { 1, 1, 2 }, { 1, 2, 1 }, { 1, 2, 2 },
+    { 2, 1, 1 }, { 2, 1, 2 }, { 2, 2, 1 }, { 2, 2, 2 },
+    { 2, 2, 3 },
+};
+
+/* the most frames in one 0x10 packet, PROTOCOL.md */
+const int PROTOCOL_MAX_FRAMES = 1024;
+
+bool failed = false;
+
+/* the ring frame decode stores for a frame in 0x0F payload layout: the
+ * wired lines, 16-bit ones in host order */
+std::vector<uint8_t> stored(const layout_case &lc, const uint8_t *frame)
+{
+    int kept = lc.lines > 2 ? 2 : lc.lines;
+    std::vector<uint8_t> out;
+
+    for (int p = 0; p < lc.ports; p++)
+    {
+        for (int l = 0; l < kept; l++)
+        {
+            const uint8_t *w = frame + lc.databits * (p * lc.lines + l);
+            if (lc.databits == 2)
+            {
+                uint16 v = (uint16)((w[0] << 8) | w[1]);
+                out.insert(out.end(), (const uint8_t *)&v, (const uint8_t *)&v + 2);
+            }
+            else
+            {
+                out.push_back(w[0]);
+            }
+        }
+    }
+    return out;
+}
+
+/* pack the frames into 0x10 packets and play them through the expander,
+ * with the ring cut down to ring_frames if that is not 0; limit says some
+ * packet has to stop at 1024 frames */
+void check(const char *name, const layout_case &lc, const std::vector<uint8_t> &movie, int ring_frames, bool limit)
+{
+    int blocksize = lc.databits * lc.ports * lc.lines;
+    long frames = (long)movie.size() / blocksize;
+    std::vector<std::vector<uint8_t>> packets;
+    std::vector<int> packet_frames;
+    bool at_limit = false;
+
+    wire_packer packer(blocksize, [&](const uint8_t *pkt, int bytes, int n) {
+        packets.emplace_back(pkt, pkt + bytes);
+        packet_frames.push_back(n);
+        return true;
+    });
+    for (long f = 0; f < frames; f++)
+    {
+        packer.add(&movie[f * blocksize]);
+    }
+    packer.finish();
+
+    ring_select(lc.databits, lc.ports, lc.lines);
+    if (ring_frames)
+    {
+        ring_size = ring_frames;
+    }
+    input_ptr = buf_ptr = ring_tail_seen = ring_head_seen = 0;
+
+    decode_fn decode = decode_select(lc.databits, lc.ports, lc.lines);
+    rle_state wire;
+    uint8_t wire_buf[PACKET_SIZE];
+    uint8_t wire_last[8 * 3];
+    long taken = 0;
+
+    rle_open(&wire, decode, blocksize, wire_buf, wire_buf, nullptr);
+
+    for (size_t k = 0; k < packets.size(); k++)
+    {
+        const std::vector<uint8_t> &pkt = packets[k];
+        const uint8_t *prev = nullptr;
+        long before = taken;
+        int n = pkt[1];
+        int stalls = 0;
+
+        if (pkt.size() != (size_t)PACKET_SIZE || pkt[0] != 0x10 || n > PACKET_SIZE - 2)
+        {
+            fprintf(stderr, "%s: packet %zu: %zu bytes, command %02X, %d token bytes\n", name, k, pkt.size(), pkt[0], n);
+            failed = true;
+            return;
+        }
+        for (int i = 2 + n; i < PACKET_SIZE; i++)
+        {
+            if (pkt[i] != 0)
+            {
+                fprintf(stderr, "%s: packet %zu: padding byte %d is %02X\n", name, k, i, pkt[i]);
+                failed = true;
+                return;
+            }
+        }
+        if (packet_frames[k] > PROTOCOL_MAX_FRAMES)
+        {
+            fprintf(stderr, "%s: packet %zu: %d frames\n", name, k, packet_frames[k]);
+            failed = true;
+            return;
+        }
+        at_limit = at_limit || packet_frames[k] == PROTOCOL_MAX_FRAMES;
+
+        /* wire_open */
+        if (wire.prev != nullptr)
+        {
+            memmove(wire_last, wire.prev, blocksize);
+            prev = wire_last;
+        }
+        memcpy(wire_buf, pkt.data() + 2, n);
+        rle_open(&wire, decode, blocksize, wire_buf, wire_buf + n, prev);
+
+        /* wire_expand until the packet is in, the latches taking frames */
+        while (!rle_done(&wire))
+        {
+            if (rle_expand(&wire) == 0 && ++stalls > 1)
+            {
+                fprintf(stderr, "%s: packet %zu: expander stuck at frame %ld\n", name, k, taken);
+                failed = true;
+                return;
+            }
+            for (; input_ptr != buf_ptr; input_ptr = ring_next(input_ptr), taken++)
+            {
+                std::vector<uint8_t> want = stored(lc, &movie[taken * blocksize]);
+                if (taken >= frames || memcmp(ring_frame(input_ptr), want.data(), want.size()) != 0)
+                {
+                    fprintf(stderr, "%s: frame %ld of %ld is wrong (packet %zu)\n", name, taken, frames, k);
+                    failed = true;
+                    return;
+                }
+            }
+        }
+        if (taken - before != packet_frames[k])
+        {
+            fprintf(stderr, "%s: packet %zu: %ld frames out, %d packed\n", name, k, taken - before, packet_frames[k]);
+            failed = true;
+            return;
+        }
+    }
+
+    if (taken != frames)
+    {
+        fprintf(stderr, "%s: %ld of %ld frames out\n", name, taken, frames);
+        failed = true;
+    }
+    if (limit && !at_limit)
+    {
+        fprintf(stderr, "%s: no packet stopped at %d frames\n", name, PROTOCOL_MAX_FRAMES);
+        failed = true;
+    }
+}
+
+std::vector<uint8_t> random_frames(std::mt19937 &rnd, int blocksize, long frames)
+{
+    std::vector<uint8_t> out(frames * blocksize);
+
+    for (uint8_t &b : out)
+    {
+        b = (uint8_t)rnd();
+    }
+    return out;
+}
+
+/* runs of 1 to 300 frames, each length around the token edges once */
+std::vector<uint8_t> run_frames(std::mt19937 &rnd, int blocksize)
+{
+    static const int edges[] = { 1, 2, 127, 128, 129, 130, 255, 256, 257, 300 };
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> frame(blocksize);
+
+    for (int len : edges)
+    {
+        for (uint8_t &b : frame)
+        {
+            b = (uint8_t)rnd();
+        }
+        for (int i = 0; i < len; i++)
+        {
+            out.insert(out.end(), frame.begin(), frame.end());
+        }
+    }
+    for (int r = 0; r < 200; r++)
+    {
+        /* a few values, so a run often repeats the frame before the last */
+        for (uint8_t &b : frame)
+        {
+            b = (uint8_t)(rnd() % 3);
+        }
+        int len = 1 + (int)(rnd() % 300);
+        for (int i = 0; i < len; i++)
+        {
+            out.insert(out.end(), frame.begin(), frame.end());
+        }
+    }
+    return out;
+}
+
+/* one frame held for a long time, as a title screen is */
+std::vector<uint8_t> held_frames(std::mt19937 &rnd, int blocksize)
+{
+    std::vector<uint8_t> out = random_frames(rnd, blocksize, 3);
+    std::vector<uint8_t> frame(out.end() - blocksize, out.end());
+
+    for (int i = 0; i < 5 * PROTOCOL_MAX_FRAMES + 17; i++)
+    {
+        out.insert(out.end(), frame.begin(), frame.end());
+    }
+    std::vector<uint8_t> tail = random_frames(rnd, blocksize, 40);
+    out.insert(out.end(), tail.begin(), tail.end());
+    return out;
+}
+
+}
+
+int main()
+{
+    std::mt19937 rnd(1);
+    char name[64];
+
+    for (const layout_case &lc : layouts)
+    {
+        int blocksize = lc.databits * lc.ports * lc.lines;
+        std::vector<uint8_t> movies[4] = {
+            random_frames(rnd, blocksize, 3000),
+            run_frames(rnd, blocksize),
+            held_frames(rnd, blocksize),
+        };
+
+        /* held frames with random stretches between them */
+        for (int part = 0; part < 20; part++)
+        {
+            std::vector<uint8_t> a = random_frames(rnd, blocksize, 1 + rnd() % 90);
+            std::vector<uint8_t> b = run_frames(rnd, blocksize);
+            movies[3].insert(movies[3].end(), a.begin(), a.end());
+            movies[3].insert(movies[3].end(), b.begin(), b.begin() + blocksize * (rnd() % 700));
+        }
+
+        for (int m = 0; m < 4; m++)
+        {
+            static const char *kinds[] = { "random", "runs", "held", "mixed" };
+
+            snprintf(name, sizeof(name), "%d-%d-%d %s", lc.databits, lc.ports, lc.lines, kinds[m]);
+            check(name, lc, movies[m], 0, m == 2);
+            snprintf(name, sizeof(name), "%d-%d-%d %s, 5 frame ring", lc.databits, lc.ports, lc.lines, kinds[m]);
+            check(name, lc, movies[m], 5, m == 2);
+        }
+    }
+
+    printf("rle: %s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
+
+/* [] END OF FILE */
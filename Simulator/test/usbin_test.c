@@ -0,0 +1,265 @@
+/* ========================================
+ * usbin.c against a stubbed OUT endpoint
+ *
+ * Plays a packet stream through the firmware's
+ * staging ring with the host, the endpoint and the
+ * main loop interleaved at random, and checks
+ * every packet comes out once, in order and
+ * intact, that a full ring leaves the packet in
+ * the endpoint (the host is NAKed) and, built with
+ * USBIN_TEST_DMA_AUTO=1, that the CPU copies
+ * nothing.
+ *
+ * The stream is a recording of what a host sent,
+ * cut into 64 byte packets, or a generated one
+ * with packets of every length.
+ *
+ * Build (or make test):
+ *   gcc -O2 -DTASBOT_HOST -DUSBIN_TEST_DMA_AUTO=0 -include test/usbuart_stub.h \
+ *       -I../TASBot.cydsn -o test/usbin_test test/usbin_test.c ../TASBot.cydsn/usbin.c
+ *
+ * Usage:
+ *   usbin_test [recording]
+ * ========================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <usbin.h>
+
+#define MAX_PACKETS 200000
+#define SEEDS 8
+
+uint8 USBUART_cdc_data_out_ep = 2;
+
+static struct
+{
+    uint8 data[USBIN_PACKET_SIZE];
+    uint16 bytes;
+} *stream;
+static int stream_len = 0;
+
+/* the endpoint: its buffer, or where DMA puts the packet when armed */
+static uint8 ep_buf[USBIN_PACKET_SIZE];
+static uint8 *ep_dst = NULL;
+static uint16 ep_count = 0;
+static int ep_full = 0;
+static int ep_armed = 0;
+
+static long copied = 0;
+/* packets the slots and the endpoint hold between them; with DMA the
+ * endpoint has nowhere to put a packet but a free slot */
+#define HELD_MAX ((int)USBIN_SLOTS + !USBIN_TEST_DMA_AUTO)
+
+/* the host NAKed with every slot taken */
+static long full_naks = 0;
+static int failed = 0;
+
+static uint32 rng;
+
+static uint32 next_rand(void)
+{
+    rng = rng * 1103515245u + 12345u;
+    return rng >> 16;
+}
+
+#define CHECK(cond, ...) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failed = 1; \
+            return; \
+        } \
+    } while(0)
+
+uint8 USBUART_GetEPState(uint8 epNumber)
+{
+    (void) epNumber;
+    return ep_full ? USBUART_OUT_BUFFER_FULL : USBUART_OUT_BUFFER_EMPTY;
+}
+
+uint16 USBUART_GetEPCount(uint8 epNumber)
+{
+    (void) epNumber;
+    return ep_count;
+}
+
+/* manual: the CPU copies the packet out and the endpoint takes the next one;
+ * DMA auto: the next packet goes to pData, nothing is copied */
+uint16 USBUART_ReadOutEP(uint8 epNumber, uint8 pData[], uint16 length)
+{
+    (void) epNumber;
+    if(USBIN_TEST_DMA_AUTO)
+    {
+        ep_dst = pData;
+        ep_full = 0;
+        return 0;
+    }
+    if(length > ep_count)
+    {
+        length = ep_count;
+    }
+    memcpy(pData, ep_buf, length);
+    copied += length;
+    ep_full = 0;
+    ep_armed = 1;
+    return length;
+}
+
+void USBUART_EnableOutEP(uint8 epNumber)
+{
+    (void) epNumber;
+    ep_armed = 1;
+}
+
+/* the host sends packet n if the endpoint takes it */
+static int host_send(int n)
+{
+    if(!ep_armed || ep_full)
+    {
+        return 0;
+    }
+    memcpy(USBIN_TEST_DMA_AUTO ? ep_dst : ep_buf, stream[n].data, stream[n].bytes);
+    ep_count = stream[n].bytes;
+    ep_full = 1;
+    ep_armed = 0;
+    return 1;
+}
+
+static void run(uint32 seed)
+{
+    usbin_packet *pkt;
+    int sent = 0;
+    int taken = 0;
+    int held;
+    long steps = 0;
+    uint32 r;
+
+    rng = seed;
+    ep_full = 0;
+    ep_armed = !USBIN_TEST_DMA_AUTO;
+    ep_dst = NULL;
+    usbin_reset();
+
+    while(taken < stream_len)
+    {
+        r = next_rand() % 8;
+        if(r < 3)
+        {
+            if(sent < stream_len)
+            {
+                if(host_send(sent))
+                {
+                    sent++;
+                }
+                else if(sent - taken == HELD_MAX)
+                {
+                    full_naks++;
+                }
+            }
+        }
+        else if(r < 6)
+        {
+            usbin_poll();
+        }
+        else
+        {
+            /* a slow decode: the main loop takes a packet now and then */
+            pkt = usbin_peek();
+            if(pkt != NULL)
+            {
+                CHECK(pkt->bytes == stream[taken].bytes && memcmp(pkt->data, stream[taken].data, pkt->bytes) == 0,
+                      "seed %u: packet %d comes out wrong", seed, taken);
+                usbin_release();
+                taken++;
+            }
+        }
+
+        held = sent - taken;
+        CHECK(held <= HELD_MAX, "seed %u: %d packets held", seed, held);
+        CHECK(++steps < 1000L * stream_len, "seed %u: stuck at packet %d", seed, taken);
+    }
+
+    usbin_poll();
+    CHECK(usbin_peek() == NULL && !ep_full, "seed %u: packets left over", seed);
+}
+
+static void load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    size_t n;
+
+    if(f == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    while(stream_len < MAX_PACKETS
+          && (n = fread(stream[stream_len].data, 1, USBIN_PACKET_SIZE, f)) > 0)
+    {
+        stream[stream_len++].bytes = (uint16) n;
+    }
+    fclose(f);
+}
+
+static void generate(void)
+{
+    int j;
+
+    rng = 1;
+    for(stream_len = 0; stream_len < 20000; stream_len++)
+    {
+        stream[stream_len].bytes = (uint16)(1 + stream_len % USBIN_PACKET_SIZE);
+        for(j = 0; j < (int)USBIN_PACKET_SIZE; j++)
+        {
+            stream[stream_len].data[j] = (uint8) next_rand();
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32 seed;
+
+    stream = calloc(MAX_PACKETS, sizeof(*stream));
+    if(stream == NULL)
+    {
+        return 1;
+    }
+
+    if(argc > 1)
+    {
+        load(argv[1]);
+    }
+    else
+    {
+        generate();
+    }
+
+    for(seed = 1; seed <= SEEDS && !failed; seed++)
+    {
+        run(seed);
+    }
+
+    if(USBIN_TEST_DMA_AUTO && copied != 0)
+    {
+        fprintf(stderr, "DMA auto: the CPU copied %ld bytes\n", copied);
+        failed = 1;
+    }
+    if(full_naks == 0)
+    {
+        fprintf(stderr, "the ring never filled up\n");
+        failed = 1;
+    }
+
+    printf("usbin %s: %d packets x %d runs, %ld NAKs on a full ring, %ld bytes copied by the CPU: %s\n",
+           USBIN_TEST_DMA_AUTO ? "DMA auto" : "manual", stream_len, SEEDS, full_naks, copied,
+           failed ? "FAIL" : "ok");
+    return failed;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,34 @@
+/* ========================================
+ * USBUART endpoint stub for usbin_test
+ *
+ * Forced into TASBot.cydsn/usbin.c on the command
+ * line (-include), in place of the generated
+ * USBUART.h that project.h brings in on the PSoC.
+ * USBIN_TEST_DMA_AUTO picks the endpoint
+ * management mode usbin.c is built for.
+ * ========================================
+ */
+#ifndef USBUART_STUB_H
+#define USBUART_STUB_H
+
+#include <stdint.h>
+
+#ifndef USBIN_TEST_DMA_AUTO
+#define USBIN_TEST_DMA_AUTO 0
+#endif
+
+#define USBUART_EP_MANAGEMENT_DMA_AUTO USBIN_TEST_DMA_AUTO
+
+#define USBUART_OUT_BUFFER_FULL  (0x01u)
+#define USBUART_OUT_BUFFER_EMPTY (0x00u)
+
+extern uint8_t USBUART_cdc_data_out_ep;
+
+uint8_t  USBUART_GetEPState(uint8_t epNumber);
+uint16_t USBUART_GetEPCount(uint8_t epNumber);
+uint16_t USBUART_ReadOutEP(uint8_t epNumber, uint8_t pData[], uint16_t length);
+void     USBUART_EnableOutEP(uint8_t epNumber);
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,95 @@
+/* ========================================
+ * Flash image packer
+ *
+ * Builds the image the firmware keeps in its
+ * flash store (TASBot.cydsn/flash.h):
+ *
+ *   24 byte header, little-endian
+ *     "TASF", version, databits, ports, lines,
+ *     frames, token bytes, FNV-1a of the tokens,
+ *     flags, 3 reserved
+ *   tokens, see rle.cpp
+ *
+ * Frames are in 0x0F payload layout, taken from
+ * the compiled packets. Packing stops at the
+ * first frame that would not fit, so a long movie
+ * gives its opening part.
+ * ========================================
+ */
+
+#include "image.h"
+#include "rle.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+const uint8_t VERSION = 1;
+const size_t HEADER_BYTES = 24;
+const uint8_t AUTOSTART = 0x01;
+
+void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+}
+
+flash_image pack_image(const packet_stream &ps, const format &fmt, size_t capacity, long max_frames, bool autostart)
+{
+    flash_image img;
+    rle_encoder enc(ps.blocksize);
+    size_t room = capacity > HEADER_BYTES ? capacity - HEADER_BYTES : 0;
+    uint32_t h = 2166136261u;
+    bool full = false;
+    long n;
+    int k;
+
+    for (n = 0; n < ps.packets && !full; n++)
+    {
+        const uint8_t *p = ps.packet(n) + 1;
+
+        for (k = 0; k < ps.packet_frames(n); k++, p += ps.blocksize)
+        {
+            if (img.frames == max_frames || enc.out.size() + enc.cost(p) > room)
+            {
+                full = true;
+                break;
+            }
+            enc.add(p);
+            img.frames++;
+        }
+    }
+
+    if (img.frames == 0)
+    {
+        fprintf(stderr, "Error: no frame fits in %zu bytes of flash\n", capacity);
+        exit(1);
+    }
+
+    for (uint8_t b : enc.out)
+    {
+        h = (h ^ b) * 16777619u;
+    }
+
+    img.bytes.resize(HEADER_BYTES);
+    memcpy(&img.bytes[0], "TASF", 4);
+    img.bytes[4] = VERSION;
+    img.bytes[5] = fmt.databits;
+    img.bytes[6] = fmt.ports;
+    img.bytes[7] = fmt.lines;
+    put32(&img.bytes[8], img.frames);
+    put32(&img.bytes[12], enc.out.size());
+    put32(&img.bytes[16], h);
+    img.bytes[20] = autostart ? AUTOSTART : 0;
+    img.bytes.insert(img.bytes.end(), enc.out.begin(), enc.out.end());
+    return img;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,31 @@
+/* ========================================
+ * Flash image packer
+ * ========================================
+ */
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "movie.h"
+
+/* the firmware's default store, TASBot.cydsn/flash.h; a device reports its own */
+const size_t FLASH_STORE_BYTES = 0x20000;
+const size_t FLASH_ROW_BYTES = 256;
+
+struct flash_image
+{
+    std::vector<uint8_t> bytes;
+    long frames = 0;
+};
+
+/* Packs as many frames from the start of the movie as fit in capacity
+ * bytes, at most max_frames if that is not negative. Exits if not even one
+ * frame fits. */
+flash_image pack_image(const packet_stream &ps, const format &fmt, size_t capacity, long max_frames, bool autostart);
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,640 @@
+/* ========================================
+ * Movie to wire packet compiler
+ *
+ * Compiling picks the bytes of each frame the
+ * device wants (e.g. bytes 0-3 and 8-11 of an r16y
+ * frame), packs them into 0x0F packets and stores
+ * the result as a flat file:
+ *
+ *   cache_header, then packets PACKET_SIZE apart
+ *
+ * named after a 64-bit FNV-1a hash of the movie
+ * file and the layout. A run maps that file and
+ * sends straight out of the mapping. Compiling
+ * streams: packets are handed out as they are
+ * built, so a first run can start playing before
+ * the whole movie is compiled.
+ *
+ * A movie can also be kept in a seekable
+ * container (write_seekable): the movie bytes in
+ * blocks of SEEK_BLOCK_BYTES, each compressed on
+ * its own with bzip2, and an index of where every
+ * block is. Skipping into such a movie, or a
+ * plain one, seeks straight to the frame; a .bz2
+ * movie has to be decompressed up to it.
+ * ========================================
+ */
+
+#include "movie.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <bzlib.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+/* bump when the packet layout changes so old cache entries are not used */
+const uint32_t CACHE_VERSION = 1;
+
+const char CACHE_MAGIC[8] = { 'T', 'A', 'S', 'P', 'K', 'T', 0, 0 };
+
+struct cache_header
+{
+    char magic[8];
+    uint64_t key;
+    int64_t frames;
+    int64_t packets;
+    int32_t blocksize;
+    int32_t frames_per_packet;
+    int32_t last_bytes;
+    uint32_t version;
+};
+
+const char SEEK_MAGIC[8] = { 'T', 'A', 'S', 'M', 'O', 'V', 'Z', 0 };
+const uint32_t SEEK_VERSION = 1;
+
+/* movie bytes per block, all blocks but the last are full */
+const uint32_t SEEK_BLOCK_BYTES = 1 << 20;
+
+/* at the start of the container, the index is at index_offset */
+struct seek_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t block_bytes;
+    uint64_t movie_bytes;
+    uint64_t index_offset;
+    uint32_t blocks;
+    uint32_t reserved;
+};
+
+/* one per block */
+struct seek_entry
+{
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t movie_bytes;
+};
+
+/* bytes of a movie frame sent to the device, port-major like the 0x0F payload */
+const format formats[] =
+{
+    { "r08",  1, 2, 1,  2, { 0, 1 } },
+    { "r16y", 2, 2, 2, 16, { 0, 1, 2, 3, 8, 9, 10, 11 } },
+    { "r16m", 2, 2, 3, 16, { 0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13 } },
+};
+
+[[noreturn]] void fail(const char *what, const char *arg)
+{
+    fprintf(stderr, "Error: %s \"%s\"\n", what, arg);
+    exit(1);
+}
+
+uint64_t fnv1a(uint64_t h, const void *buf, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+
+    while (len--)
+    {
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* mapping of a whole file, empty files give nullptr */
+const uint8_t *map_file(int fd, size_t &len)
+{
+    struct stat st;
+    void *p;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        len = 0;
+        return nullptr;
+    }
+    len = st.st_size;
+    p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    return (p == MAP_FAILED) ? nullptr : static_cast<const uint8_t *>(p);
+}
+
+uint64_t cache_key(const char *movie_path, const layout &lay)
+{
+    int fd = open(movie_path, O_RDONLY);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const uint8_t *p;
+    size_t len;
+    long params[2] = { lay.extra, lay.skip };
+
+    if (fd < 0)
+    {
+        fail("not found", movie_path);
+    }
+    p = map_file(fd, len);
+    if (p != nullptr)
+    {
+        h = fnv1a(h, p, len);
+        munmap(const_cast<uint8_t *>(p), len);
+    }
+    close(fd);
+
+    h = fnv1a(h, &CACHE_VERSION, sizeof(CACHE_VERSION));
+    h = fnv1a(h, lay.fmt->name, strlen(lay.fmt->name));
+    return fnv1a(h, params, sizeof(params));
+}
+
+/* decompressed bytes of a movie file: a seekable container by its magic,
+ * .bz2 by extension, anything else as it is */
+class movie_reader
+{
+public:
+    explicit movie_reader(const char *path)
+        : path(path)
+    {
+        size_t len = strlen(path);
+        seek_header hdr;
+
+        f = fopen(path, "rb");
+        if (f == nullptr)
+        {
+            fail("not found", path);
+        }
+        if (fread(&hdr, sizeof(hdr), 1, f) == 1 && memcmp(hdr.magic, SEEK_MAGIC, sizeof(hdr.magic)) == 0)
+        {
+            open_index(hdr);
+            return;
+        }
+        rewind(f);
+        if (len > 4 && strcasecmp(path + len - 4, ".bz2") == 0)
+        {
+            bz = BZ2_bzReadOpen(&err, f, 0, 0, nullptr, 0);
+        }
+    }
+
+    ~movie_reader()
+    {
+        if (bz != nullptr)
+        {
+            BZ2_bzReadClose(&err, bz);
+        }
+        fclose(f);
+    }
+
+    /* up to len bytes, 0 at the end of the movie */
+    size_t read(uint8_t *buf, size_t len)
+    {
+        int n;
+
+        if (!index.empty())
+        {
+            if (block_pos == block.size())
+            {
+                if (next_block == index.size())
+                {
+                    return 0;
+                }
+                load_block(next_block++);
+            }
+            len = std::min(len, block.size() - block_pos);
+            memcpy(buf, &block[block_pos], len);
+            block_pos += len;
+            return len;
+        }
+        if (bz == nullptr)
+        {
+            return fread(buf, 1, len, f);
+        }
+        if (err == BZ_STREAM_END)
+        {
+            return 0;
+        }
+        n = BZ2_bzRead(&err, bz, buf, (int)len);
+        if (err != BZ_OK && err != BZ_STREAM_END)
+        {
+            fail("could not decompress", path);
+        }
+        return n;
+    }
+
+    /* to pos bytes into the movie, before anything has been read */
+    void seek(uint64_t pos)
+    {
+        std::vector<uint8_t> buf(65536);
+        size_t b;
+
+        if (!index.empty())
+        {
+            b = pos / block_bytes;
+            if (b < index.size())
+            {
+                load_block(b);
+                block_pos = std::min((size_t)(pos - (uint64_t)b * block_bytes), block.size());
+            }
+            next_block = std::min(b + 1, index.size());
+            return;
+        }
+        if (bz == nullptr)
+        {
+            if (fseeko(f, (off_t)pos, SEEK_SET) != 0)
+            {
+                fail("could not seek in", path);
+            }
+            return;
+        }
+
+        /* no index, decompress up to it */
+        while (pos > 0)
+        {
+            size_t n = read(&buf[0], std::min((uint64_t)buf.size(), pos));
+
+            if (n == 0)
+            {
+                break;
+            }
+            pos -= n;
+        }
+    }
+
+private:
+    void open_index(const seek_header &hdr)
+    {
+        if (hdr.version != SEEK_VERSION || hdr.blocks == 0 || hdr.block_bytes == 0)
+        {
+            fail("unknown container version", path);
+        }
+        index.resize(hdr.blocks);
+        block_bytes = hdr.block_bytes;
+        if (fseeko(f, (off_t)hdr.index_offset, SEEK_SET) != 0
+            || fread(index.data(), sizeof(seek_entry), index.size(), f) != index.size())
+        {
+            fail("could not read the index of", path);
+        }
+    }
+
+    void load_block(size_t n)
+    {
+        std::vector<uint8_t> packed(index[n].bytes);
+        unsigned int out = index[n].movie_bytes;
+
+        block.resize(index[n].movie_bytes);
+        block_pos = 0;
+        if (fseeko(f, (off_t)index[n].offset, SEEK_SET) != 0 || fread(packed.data(), 1, packed.size(), f) != packed.size()
+            || BZ2_bzBuffToBuffDecompress(reinterpret_cast<char *>(block.data()), &out,
+                   reinterpret_cast<char *>(packed.data()), packed.size(), 0, 0) != BZ_OK
+            || out != index[n].movie_bytes)
+        {
+            fail("could not decompress", path);
+        }
+    }
+
+    const char *path;
+    FILE *f = nullptr;
+    BZFILE *bz = nullptr;
+    int err = BZ_OK;
+
+    /* seekable container */
+    std::vector<seek_entry> index;
+    uint32_t block_bytes = 0;
+    std::vector<uint8_t> block;
+    size_t block_pos = 0;
+    size_t next_block = 0;
+};
+
+/* Packs frames into 0x0F packets. A full packet is held until the next
+ * frame shows it is not the last one, so only the last packet is short. */
+class packer
+{
+public:
+    packer(const format &fmt, const packet_sink &sink)
+        : fmt(fmt), sink(sink)
+    {
+        blocksize = fmt.databits * fmt.ports * fmt.lines;
+        frames_per_packet = (PACKET_SIZE - 1) / blocksize;
+    }
+
+    /* nullptr adds a blank frame */
+    bool add(const uint8_t *frame)
+    {
+        uint8_t *dst;
+        int k;
+
+        if (held == frames_per_packet && !flush(PACKET_SIZE))
+        {
+            return false;
+        }
+
+        dst = &pkt[1 + held * blocksize];
+        for (k = 0; k < blocksize; k++)
+        {
+            dst[k] = frame ? frame[fmt.pick[k]] : 0;
+        }
+        held++;
+        frames++;
+        return true;
+    }
+
+    bool finish()
+    {
+        return held == 0 || flush(1 + held * blocksize);
+    }
+
+    int blocksize;
+    int frames_per_packet;
+    long frames = 0;
+    long packets = 0;
+    int last_bytes = 0;
+
+private:
+    bool flush(int bytes)
+    {
+        pkt[0] = 0x0F;
+        memset(&pkt[1 + held * blocksize], 0, PACKET_SIZE - 1 - held * blocksize);
+        packets++;
+        last_bytes = bytes;
+        if (!sink(pkt, bytes, held))
+        {
+            return false;
+        }
+        held = 0;
+        return true;
+    }
+
+    const format &fmt;
+    const packet_sink &sink;
+    uint8_t pkt[PACKET_SIZE];
+    int held = 0;
+};
+
+std::string entry_path(const char *cache_dir, uint64_t key)
+{
+    char name[32];
+
+    snprintf(name, sizeof(name), "/%016llx.pkt", (unsigned long long)key);
+    return std::string(cache_dir) + name;
+}
+
+void make_dirs(const std::string &dir)
+{
+    size_t i;
+
+    for (i = 1; i <= dir.size(); i++)
+    {
+        if (i == dir.size() || dir[i] == '/')
+        {
+            if (mkdir(dir.substr(0, i).c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                fail("could not create", dir.c_str());
+            }
+        }
+    }
+}
+
+/* the cache entry at path if it is complete and for key */
+bool map_entry(const std::string &path, uint64_t key, packet_stream &ps)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    const uint8_t *p;
+    const cache_header *hdr;
+    size_t len;
+
+    if (fd < 0)
+    {
+        return false;
+    }
+    p = map_file(fd, len);
+    close(fd);
+    if (p == nullptr)
+    {
+        return false;
+    }
+
+    hdr = reinterpret_cast<const cache_header *>(p);
+    if (len < sizeof(*hdr) || memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0
+        || hdr->key != key || hdr->version != CACHE_VERSION || hdr->packets == 0
+        || len != sizeof(*hdr) + (hdr->packets - 1) * PACKET_SIZE + hdr->last_bytes)
+    {
+        munmap(const_cast<uint8_t *>(p), len);
+        return false;
+    }
+
+    /* the live loop walks it front to back */
+    madvise(const_cast<uint8_t *>(p), len, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    ps.wire = p + sizeof(*hdr);
+    ps.wire_bytes = len - sizeof(*hdr);
+    ps.packets = hdr->packets;
+    ps.frames = hdr->frames;
+    ps.blocksize = hdr->blocksize;
+    ps.frames_per_packet = hdr->frames_per_packet;
+    ps.last_bytes = hdr->last_bytes;
+    return true;
+}
+
+}
+
+const format *find_format(const char *name)
+{
+    for (const format &f : formats)
+    {
+        if (strcmp(f.name, name) == 0)
+        {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+const char *default_cache_dir()
+{
+    static std::string dir;
+    const char *base = getenv("XDG_CACHE_HOME");
+
+    if (base != nullptr && base[0] != '\0')
+    {
+        dir = std::string(base) + "/tasbot";
+    }
+    else
+    {
+        base = getenv("HOME");
+        dir = std::string(base ? base : ".") + "/.cache/tasbot";
+    }
+    return dir.c_str();
+}
+
+bool open_packets(const char *movie_path, const layout &lay, const char *cache_dir, packet_stream &ps)
+{
+    uint64_t key = cache_key(movie_path, lay);
+
+    return map_entry(entry_path(cache_dir, key), key, ps);
+}
+
+bool compile_packets(const char *movie_path, const layout &lay, const char *cache_dir, const packet_sink &sink)
+{
+    const format &fmt = *lay.fmt;
+    uint64_t key = cache_dir ? cache_key(movie_path, lay) : 0;
+    std::string path = cache_dir ? entry_path(cache_dir, key) : "";
+    std::string tmp = path + "." + std::to_string(getpid());
+    movie_reader movie(movie_path);
+    std::vector<uint8_t> buf(65536 + fmt.stride);
+    cache_header hdr = {};
+    FILE *out = nullptr;
+    size_t have = 0, got, pos;
+    long f;
+    bool ok = true;
+
+    /* every packet goes to the entry as well as to the sink */
+    packet_sink both = [&](const uint8_t *data, int bytes, int frames)
+    {
+        if (out != nullptr && fwrite(data, 1, bytes, out) != (size_t)bytes)
+        {
+            fail("could not write", tmp.c_str());
+        }
+        return !sink || sink(data, bytes, frames);
+    };
+    packer pk(fmt, both);
+
+    /* written aside and renamed, so a run never maps half an entry */
+    if (cache_dir != nullptr)
+    {
+        make_dirs(cache_dir);
+        out = fopen(tmp.c_str(), "wb");
+        if (out == nullptr || fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+        {
+            fail("could not write", tmp.c_str());
+        }
+    }
+
+    for (f = 0; ok && f < lay.extra; f++)
+    {
+        ok = pk.add(nullptr);
+    }
+    movie.seek((uint64_t)lay.skip * fmt.stride);
+
+    while (ok && (got = movie.read(&buf[have], buf.size() - have)) > 0)
+    {
+        have += got;
+        for (pos = 0; ok && pos + fmt.stride <= have; pos += fmt.stride)
+        {
+            ok = pk.add(&buf[pos]);
+        }
+        memmove(&buf[0], &buf[pos], have - pos);
+        have -= pos;
+    }
+    ok = ok && pk.finish();
+
+    if (!ok || pk.packets == 0)
+    {
+        if (out != nullptr)
+        {
+            fclose(out);
+            unlink(tmp.c_str());
+        }
+        if (ok)
+        {
+            fail("no frames in", movie_path);
+        }
+        return false;
+    }
+    if (out == nullptr)
+    {
+        return true;
+    }
+
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.key = key;
+    hdr.version = CACHE_VERSION;
+    hdr.frames = pk.frames;
+    hdr.packets = pk.packets;
+    hdr.blocksize = pk.blocksize;
+    hdr.frames_per_packet = pk.frames_per_packet;
+    hdr.last_bytes = pk.last_bytes;
+    if (fseek(out, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, out) != 1 || fclose(out) != 0
+        || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        fail("could not write", tmp.c_str());
+    }
+    return true;
+}
+
+uint64_t write_seekable(const char *movie_path, const char *out_path)
+{
+    movie_reader movie(movie_path);
+    std::vector<uint8_t> buf(SEEK_BLOCK_BYTES);
+    std::vector<uint8_t> packed(SEEK_BLOCK_BYTES + SEEK_BLOCK_BYTES / 100 + 600);
+    std::vector<seek_entry> index;
+    seek_header hdr = {};
+    uint64_t offset = sizeof(hdr);
+    size_t have, got;
+    unsigned int n;
+    FILE *out = fopen(out_path, "wb");
+
+    if (out == nullptr || fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+    {
+        fail("could not write", out_path);
+    }
+
+    do
+    {
+        for (have = 0; have < buf.size() && (got = movie.read(&buf[have], buf.size() - have)) > 0; have += got)
+        {
+        }
+        if (have == 0)
+        {
+            break;
+        }
+        n = packed.size();
+        if (BZ2_bzBuffToBuffCompress(reinterpret_cast<char *>(packed.data()), &n,
+                reinterpret_cast<char *>(buf.data()), have, 9, 0, 0) != BZ_OK
+            || fwrite(packed.data(), 1, n, out) != n)
+        {
+            fail("could not write", out_path);
+        }
+        index.push_back({ offset, n, (uint32_t)have });
+        offset += n;
+        hdr.movie_bytes += have;
+    }
+    while (have == buf.size());
+
+    if (index.empty())
+    {
+        fail("no frames in", movie_path);
+    }
+
+    memcpy(hdr.magic, SEEK_MAGIC, sizeof(hdr.magic));
+    hdr.version = SEEK_VERSION;
+    hdr.block_bytes = SEEK_BLOCK_BYTES;
+    hdr.index_offset = offset;
+    hdr.blocks = index.size();
+    if (fwrite(index.data(), sizeof(seek_entry), index.size(), out) != index.size()
+        || fseek(out, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, out) != 1 || fclose(out) != 0)
+    {
+        fail("could not write", out_path);
+    }
+    return hdr.movie_bytes;
+}
+
+packet_stream load_packets(const char *movie_path, const layout &lay, const char *cache_dir, bool &cached)
+{
+    packet_stream ps;
+
+    cached = open_packets(movie_path, lay, cache_dir, ps);
+    if (!cached && (!compile_packets(movie_path, lay, cache_dir, nullptr)
+                    || !open_packets(movie_path, lay, cache_dir, ps)))
+    {
+        fail("could not map", movie_path);
+    }
+    return ps;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,82 @@
+/* ========================================
+ * Movie to wire packet compiler
+ * ========================================
+ */
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+const int PACKET_SIZE = 64;
+
+struct format
+{
+    const char *name;
+    int databits;
+    int ports;
+    int lines;
+    int stride;
+    int pick[12];
+};
+
+/* r08, r16y or r16m, nullptr for anything else */
+const format *find_format(const char *name);
+
+/* what the packets are compiled for, any change gives a different cache entry */
+struct layout
+{
+    const format *fmt;
+    long extra;
+    long skip;
+};
+
+/* the movie as 0x0F wire packets, all PACKET_SIZE apart, only the last one short */
+struct packet_stream
+{
+    const uint8_t *wire = nullptr;
+    size_t wire_bytes = 0;
+    long packets = 0;
+    long frames = 0;
+    int blocksize = 0;
+    int frames_per_packet = 0;
+    int last_bytes = 0;
+
+    const uint8_t *packet(long n) const { return wire + n * PACKET_SIZE; }
+    int packet_bytes(long n) const { return (n == packets - 1) ? last_bytes : PACKET_SIZE; }
+    int packet_frames(long n) const { return (packet_bytes(n) - 1) / blocksize; }
+};
+
+/* takes each compiled packet (data, bytes, frames), false stops compiling */
+typedef std::function<bool(const uint8_t *, int, int)> packet_sink;
+
+/* Maps the packets of the movie file for this layout if the packet cache
+ * in cache_dir has them. */
+bool open_packets(const char *movie_path, const layout &lay, const char *cache_dir, packet_stream &ps);
+
+/* Compiles the movie into the packet cache, passing each packet to sink (if
+ * any) as it is built. The data passed is only valid during the call.
+ * Returns false when sink stopped it; nothing is cached then. A cache_dir
+ * of nullptr only compiles for the sink. */
+bool compile_packets(const char *movie_path, const layout &lay, const char *cache_dir, const packet_sink &sink);
+
+/* Maps the packets of the movie file for this layout from the packet
+ * cache in cache_dir, compiling them into it first if they are not there.
+ * The cache key is a hash of the file's bytes and the layout, so an edited
+ * movie or other settings compile again. Sets cached when nothing had to be
+ * compiled. Exits on errors. */
+packet_stream load_packets(const char *movie_path, const layout &lay, const char *cache_dir, bool &cached);
+
+/* Writes the movie file (plain, .bz2 or a container) to out_path as a
+ * seekable container, which plays and compiles like any other movie file
+ * but skips to a frame without decompressing what is before it. Returns the
+ * movie bytes. Exits on errors. */
+uint64_t write_seekable(const char *movie_path, const char *out_path);
+
+/* $XDG_CACHE_HOME/tasbot or ~/.cache/tasbot */
+const char *default_cache_dir();
+
+#endif
+
+/* [] END OF FILE */
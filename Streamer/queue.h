@@ -0,0 +1,184 @@
+/* ========================================
+ * Packet queue
+ *
+ * Bounded single producer, single consumer queue
+ * between the feeder thread, which reads or
+ * compiles the movie, and the responder, which
+ * answers the device. Entries point either into
+ * the mapped packet cache or into the queue's own
+ * slot for that entry, which holds packets the
+ * feeder is still compiling. The responder peeks
+ * at what is ready and pops what it has written;
+ * only when the queue has run dry does it block.
+ * Either side only wakes the other when it is
+ * asleep, and a full queue wakes the producer once
+ * there is room for a batch, so the responder
+ * rarely pays for a wakeup.
+ * ========================================
+ */
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include "movie.h"
+
+struct packet_ref
+{
+    const uint8_t *data;
+    int bytes;
+    int frames;
+};
+
+class packet_queue
+{
+public:
+    /* 512 packets are over 3500 r16y frames, about a minute of play */
+    static const long CAPACITY = 512;
+
+    /* producer: queue a packet that stays valid, false once closed */
+    bool push(const packet_ref &ref)
+    {
+        if (!wait_room())
+        {
+            return false;
+        }
+        refs[head % CAPACITY] = ref;
+        publish(ref.frames);
+        return true;
+    }
+
+    /* producer: queue a copy of a packet, false once closed */
+    bool push_copy(const uint8_t *data, int bytes, int frames)
+    {
+        uint8_t *slot;
+
+        if (!wait_room())
+        {
+            return false;
+        }
+        slot = slots[head % CAPACITY];
+        memcpy(slot, data, bytes);
+        refs[head % CAPACITY] = { slot, bytes, frames };
+        publish(frames);
+        return true;
+    }
+
+    /* producer: no more packets */
+    void finish()
+    {
+        std::lock_guard<std::mutex> l(lock);
+        finished = true;
+        changed.notify_all();
+    }
+
+    /* consumer: packets ready to send */
+    long ready() const
+    {
+        return head - tail;
+    }
+
+    /* consumer: wait until more than n packets are ready, false if they never will be */
+    bool wait_ready(long n)
+    {
+        std::unique_lock<std::mutex> l(lock);
+
+        if (head - tail > n)
+        {
+            return true;
+        }
+        if (!finished)
+        {
+            starved++;
+        }
+        consumer_waiting = true;
+        changed.wait(l, [this, n] { return head - tail > n || finished; });
+        consumer_waiting = false;
+        return head - tail > n;
+    }
+
+    /* consumer: the n-th ready packet */
+    const packet_ref &peek(long n) const
+    {
+        return refs[(tail + n) % CAPACITY];
+    }
+
+    /* consumer: release the first n ready packets */
+    void pop(long n)
+    {
+        std::lock_guard<std::mutex> l(lock);
+        tail += n;
+        if (producer_waiting && head - tail <= CAPACITY - REFILL)
+        {
+            changed.notify_all();
+        }
+    }
+
+    /* consumer: stop the producer */
+    void close()
+    {
+        std::lock_guard<std::mutex> l(lock);
+        closed = true;
+        changed.notify_all();
+    }
+
+    /* consumer: no packets now or later */
+    bool done() const
+    {
+        return finished && head == tail;
+    }
+
+    /* frames queued so far, the movie length once finished */
+    std::atomic<long> frames{0};
+
+    /* times the consumer found the queue empty */
+    long starved = 0;
+
+private:
+    bool wait_room()
+    {
+        std::unique_lock<std::mutex> l(lock);
+
+        if (head - tail == CAPACITY)
+        {
+            /* sleep until there is room for a batch, not for every pop */
+            producer_waiting = true;
+            changed.wait(l, [this] { return head - tail <= CAPACITY - REFILL || closed; });
+            producer_waiting = false;
+        }
+        return !closed;
+    }
+
+    void publish(int n)
+    {
+        std::lock_guard<std::mutex> l(lock);
+        head++;
+        frames += n;
+        if (consumer_waiting)
+        {
+            changed.notify_all();
+        }
+    }
+
+    /* free entries that wake a producer waiting on a full queue */
+    static const long REFILL = CAPACITY / 4;
+
+    packet_ref refs[CAPACITY];
+    uint8_t slots[CAPACITY][PACKET_SIZE];
+    std::atomic<long> head{0};
+    std::atomic<long> tail{0};
+    std::atomic<bool> finished{false};
+    bool closed = false;
+    bool producer_waiting = false;
+    bool consumer_waiting = false;
+    std::mutex lock;
+    std::condition_variable changed;
+};
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,111 @@
+/* ========================================
+ * Run length coding of frames
+ *
+ * The token format the firmware expands, for flash
+ * images (image.cpp) and for 0x10 packets:
+ *
+ *   0x10, token bytes, tokens, padding to 64
+ *
+ * A frame equal to the one before it costs nothing
+ * but part of a run byte, which is most of a TAS,
+ * so one packet carries up to WIRE_MAX_FRAMES
+ * frames instead of the seven or so of a 0x0F
+ * packet. The frame before a packet's first run is
+ * the last literal frame of the packets before it,
+ * the device keeps it.
+ * ========================================
+ */
+
+#include "rle.h"
+
+#include <cstring>
+
+namespace
+{
+
+/* command byte and token count */
+const int WIRE_HEADER = 2;
+
+}
+
+rle_encoder::rle_encoder(int blocksize)
+    : blocksize(blocksize)
+{
+}
+
+size_t rle_encoder::cost(const uint8_t *frame) const
+{
+    if (repeats(frame))
+    {
+        return (run && count < RLE_TOKEN_FRAMES) ? 0 : 1;
+    }
+    return (!run && count > 0 && count < RLE_TOKEN_FRAMES) ? blocksize : 1 + blocksize;
+}
+
+void rle_encoder::add(const uint8_t *frame)
+{
+    bool again = repeats(frame);
+
+    if (count == 0 || count == RLE_TOKEN_FRAMES || again != run)
+    {
+        token = out.size();
+        out.push_back(again ? RLE_RUN : 0);
+        run = again;
+        count = 0;
+    }
+    if (!again)
+    {
+        out.insert(out.end(), frame, frame + blocksize);
+        last.assign(frame, frame + blocksize);
+    }
+    out[token] = (run ? RLE_RUN : 0) | count;
+    count++;
+}
+
+void rle_encoder::restart()
+{
+    out.clear();
+    count = 0;
+    run = false;
+}
+
+bool rle_encoder::repeats(const uint8_t *frame) const
+{
+    return !last.empty() && memcmp(last.data(), frame, blocksize) == 0;
+}
+
+wire_packer::wire_packer(int blocksize, const packet_sink &sink)
+    : enc(blocksize), sink(sink)
+{
+}
+
+bool wire_packer::add(const uint8_t *frame)
+{
+    if (frames == WIRE_MAX_FRAMES || WIRE_HEADER + enc.out.size() + enc.cost(frame) > (size_t)PACKET_SIZE)
+    {
+        if (!finish())
+        {
+            return false;
+        }
+    }
+    enc.add(frame);
+    frames++;
+    return true;
+}
+
+bool wire_packer::finish()
+{
+    uint8_t pkt[PACKET_SIZE] = { 0x10, (uint8_t)enc.out.size() };
+    int n = frames;
+
+    if (n == 0)
+    {
+        return true;
+    }
+    memcpy(pkt + WIRE_HEADER, enc.out.data(), enc.out.size());
+    enc.restart();
+    frames = 0;
+    return sink(pkt, PACKET_SIZE, n);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,69 @@
+/* ========================================
+ * Run length coding of frames
+ * ========================================
+ */
+#ifndef RLE_H
+#define RLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "movie.h"
+
+/* tokens, TASBot.cydsn/decode.h: 0x00-0x7F are followed by 1-128 literal
+ * frames, 0x80-0xFF repeat the frame before them 1-128 times */
+const uint8_t RLE_RUN = 0x80;
+const int RLE_TOKEN_FRAMES = 128;
+
+/* most frames in one 0x10 packet, a sixth of the smallest device ring */
+const int WIRE_MAX_FRAMES = 1024;
+
+/* appends frames to a token stream, tracking the open token */
+class rle_encoder
+{
+public:
+    explicit rle_encoder(int blocksize);
+
+    /* bytes adding frame would take */
+    size_t cost(const uint8_t *frame) const;
+
+    void add(const uint8_t *frame);
+
+    /* start another token stream, a run at its start repeats the last frame */
+    void restart();
+
+    std::vector<uint8_t> out;
+
+private:
+    bool repeats(const uint8_t *frame) const;
+
+    int blocksize;
+    std::vector<uint8_t> last;
+    size_t token = 0;
+    int count = 0;
+    bool run = false;
+};
+
+/* Packs frames into 0x10 packets of at most WIRE_MAX_FRAMES frames, each
+ * padded to PACKET_SIZE, and passes every packet to sink. */
+class wire_packer
+{
+public:
+    wire_packer(int blocksize, const packet_sink &sink);
+
+    /* false once sink has stopped it */
+    bool add(const uint8_t *frame);
+
+    /* the last packet, if any */
+    bool finish();
+
+private:
+    rle_encoder enc;
+    packet_sink sink;
+    int frames = 0;
+};
+
+#endif
+
+/* [] END OF FILE */
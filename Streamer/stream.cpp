@@ -0,0 +1,1225 @@
+/* ========================================
+ * TASBot host streamer
+ *
+ * Native replacement for the play_*.py scripts.
+ * The movie is compiled into 0x0F wire packets
+ * once and kept in a packet cache (see movie.cpp);
+ * a feeder thread queues the mapped packets (or
+ * compiles them on a first run) ahead of the
+ * responder, which only waits for requests and
+ * writes packets that are already built. All that
+ * one read of the device asks for goes out in one
+ * writev() straight from the mapping or queue. The
+ * time from the read to that write returning is
+ * recorded and reported as a histogram when the
+ * run ends, with syscalls and CPU time per frame.
+ *
+ * Packets are padded to the 64 byte USB packet
+ * size so several of them can go out in one write
+ * and still arrive one per USB packet; only the
+ * last packet of the movie is short. With -z the
+ * feeder run length codes the cached frames into
+ * 0x10 packets as it queues them (see rle.cpp),
+ * all of them padded.
+ *
+ * Build:
+ *   g++ -O2 -std=c++17 -o tasbot_stream stream.cpp movie.cpp image.cpp rle.cpp -lbz2 -pthread
+ *
+ * Usage:
+ *   tasbot_stream [options] <device> <movie[.bz2]>
+ *   tasbot_stream -x [-f -e -s -C] <movie[.bz2]>
+ *   tasbot_stream -W image [-f -e -s -n -A -C] <movie[.bz2]>
+ *   tasbot_stream -Z container <movie[.bz2]>
+ *     -f format     r08, r16y, r16m (default r16y)
+ *     -b            use credit based refill
+ *     -z            send the frames run length coded, many more per
+ *                   packet on a typical TAS
+ *     -e frames     blank frames before the movie
+ *     -s frames     skip frames at the start of the movie
+ *     -w period     window mode, port 1 window timer period
+ *     -o latch      turn window mode off at this latch
+ *     -k period     clock filter period on both ports (DPCM fix)
+ *     -K latch      set the clock filter back to 2 at this latch
+ *     -E latch:cmd[:byte[:byte]]
+ *                   send a setting command (0xA0-0xD0) at this latch,
+ *                   may be repeated
+ *     -R start:end:period
+ *                   window mode with this window period from latch start
+ *                   up to latch end, may be repeated; these, -E and -K
+ *                   are scheduled on the device (0xA5, 0xA6), so they
+ *                   take effect on the latch
+ *     -a port:bits  autolatch on controller port (0 or 1) every bits clocks
+ *     -c latch      command mode starts at this latch
+ *     -t latches    ask for a telemetry report every this many latches
+ *     -T            on ^C, read the device's ISR timing before exiting
+ *     -v            print the latency of every request
+ *     -C dir        packet cache (default $XDG_CACHE_HOME/tasbot)
+ *     -x            only compile the movie into the cache
+ *     -F            pack the movie, or as much of it as fits, into the
+ *                   device's flash and play it from there; the device
+ *                   needs no host once it runs, this only listens
+ *     -H            as -F, but play only the start of the movie from
+ *                   flash and stream the rest from the frame after it,
+ *                   instead of preloading over USB
+ *     -W image      write the flash image to a file instead (for the
+ *                   simulator's -F or -H)
+ *     -n frames     pack at most this many frames into flash
+ *     -A            mark the image to play by itself from power-up
+ *     -L latch      resume a run at this latch: the movie is sent from
+ *                   the frame at it and the device counts on from it
+ *                   (0x02), scheduled settings as they were at it; a
+ *                   cached movie is sent from its entry, an uncached
+ *                   one compiled from the frame on and not cached
+ *     -Z container  write the movie as a seekable container, which
+ *                   plays like the movie and lets -L and -s start
+ *                   anywhere in it at once
+ *
+ * The scripts map to:
+ *   play_r08.py          -f r08
+ *   play_r16m.py         -f r16m
+ *   play_r16y.py         -f r16y -e 1 -b
+ *   play_r16y_SMB3.py    -f r16y -e 1 -w 16384 -o 2122 -k 128 -K 16800
+ *   play_r16y_cmd_init.py  -f r16y -s 1 -c 13103 -a 1:16
+ *
+ * Testing without hardware, the simulator can act
+ * as the device on a pty (see Simulator/sim.c):
+ *   tasbot_sim -P -f r16y movie.r16y
+ *   tasbot_stream -f r16y /dev/pts/N movie.r16y
+ * ========================================
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "movie.h"
+#include "queue.h"
+#include "rle.h"
+
+namespace
+{
+
+/* device messages longer than a byte, with their payload */
+const int GRANT_BYTES = 3;
+const int TELEMETRY_BYTES = 19;
+const int TIMING_BYTES = 54;
+const int TIMING_SLOTS = 5;
+const int FLASH_BYTES = 3;
+const int FLASH_FAILED = 0xFFFF;
+
+/* 0xA5 events: latch, command and two payload bytes; 0xA6 window ranges:
+ * start, end and period, each taking three of the device's event slots */
+const int EVENT_BYTES = 7;
+const int WINDOW_BYTES = 10;
+const int WINDOW_EVENTS = 3;
+const int EVENT_SLOTS = 64;
+
+int message_bytes(uint8_t id)
+{
+    switch (id)
+    {
+        case 0x0E:
+            return GRANT_BYTES;
+        case 0x0C:
+            return TELEMETRY_BYTES;
+        case 0x0B:
+            return TIMING_BYTES;
+        case 0x0A:
+            return FLASH_BYTES;
+        default:
+            return 1;
+    }
+}
+
+/* a setting command the device applies at a latch */
+struct scheduled
+{
+    long latch;
+    uint8_t cmd[3];
+};
+
+/* window mode from latch start up to end, with its own window period */
+struct window_range
+{
+    long start;
+    long end;
+    long period;
+};
+
+struct options
+{
+    const format *fmt = find_format("r16y");
+    const char *cache_dir = default_cache_dir();
+    bool compile_only = false;
+    bool credit = false;
+    bool rle = false;
+    long extra = 0;
+    long skip = 0;
+    long window = -1;
+    long window_off = -1;
+    long clock_filter = -1;
+    int autolatch_port = -1;
+    int autolatch_bits = 16;
+    long cmd_mode = -1;
+    std::vector<scheduled> events;
+    std::vector<window_range> windows;
+    long telemetry = 0;
+    bool timing = false;
+    bool verbose = false;
+    bool flash = false;
+    bool hybrid = false;
+    const char *image_path = nullptr;
+    long flash_frames = -1;
+    bool autostart = false;
+    long resume = 0;
+    const char *seekable_path = nullptr;
+};
+
+struct run_stats
+{
+    long requests = 0;
+    long grants = 0;
+    long writes = 0;
+    long reads = 0;
+    long cpu_us = 0;
+    long frames = 0;
+    long packets = 0;
+    std::vector<long> latency_ns;
+};
+
+volatile sig_atomic_t stop = 0;
+
+void on_signal(int)
+{
+    stop = 1;
+}
+
+/* user and system time of the calling thread */
+long thread_cpu_us()
+{
+    rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000L + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+long now_ns()
+{
+    timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+[[noreturn]] void fail(const char *what, const char *arg)
+{
+    fprintf(stderr, "Error: %s \"%s\"\n", what, arg);
+    exit(1);
+}
+
+int open_device(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    termios tio;
+
+    if (fd < 0)
+    {
+        fail("could not open", path);
+    }
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, B2000000);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+void write_all(int fd, const uint8_t *buf, size_t len, run_stats &st)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        st.writes++;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("write");
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+void send_command(int fd, std::initializer_list<uint8_t> bytes, run_stats &st)
+{
+    std::vector<uint8_t> cmd(bytes);
+
+    write_all(fd, cmd.data(), cmd.size(), st);
+}
+
+void put32(std::vector<uint8_t> &out, long v)
+{
+    out.push_back((uint8_t)(v >> 24));
+    out.push_back((uint8_t)(v >> 16));
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+/* entries of size bytes in cmd packets behind a count, each padded so they
+ * can go in one write */
+void send_entries(int fd, uint8_t cmd, const std::vector<uint8_t> &entries, size_t size, run_stats &st)
+{
+    size_t per_packet = (PACKET_SIZE - 2) / size;
+    std::vector<uint8_t> wire;
+
+    for (size_t pos = 0; pos < entries.size(); pos += per_packet * size)
+    {
+        size_t len = std::min(entries.size() - pos, per_packet * size);
+        size_t start = wire.size();
+
+        wire.push_back(cmd);
+        wire.push_back((uint8_t)(len / size));
+        wire.insert(wire.end(), &entries[pos], &entries[pos] + len);
+        wire.resize(start + PACKET_SIZE);
+    }
+    write_all(fd, wire.data(), wire.size(), st);
+}
+
+/* the settings scheduled by latch, 0xA5 events and 0xA6 window ranges */
+void send_schedule(int fd, const options &opt, run_stats &st)
+{
+    std::vector<uint8_t> events, windows;
+
+    for (const scheduled &e : opt.events)
+    {
+        put32(events, e.latch);
+        events.insert(events.end(), e.cmd, e.cmd + 3);
+    }
+    for (const window_range &w : opt.windows)
+    {
+        put32(windows, w.start);
+        put32(windows, w.end);
+        windows.push_back((uint8_t)(w.period >> 8));
+        windows.push_back((uint8_t)w.period);
+    }
+    if (!events.empty())
+    {
+        send_entries(fd, 0xA5, events, EVENT_BYTES, st);
+    }
+    if (!windows.empty())
+    {
+        send_entries(fd, 0xA6, windows, WINDOW_BYTES, st);
+    }
+}
+
+/* wait up to timeout_ms for one byte */
+int read_byte(int fd, int timeout_ms)
+{
+    pollfd pfd = { fd, POLLIN, 0 };
+    uint8_t c;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0 || read(fd, &c, 1) != 1)
+    {
+        return -1;
+    }
+    return c;
+}
+
+/* the frames of a 0x0F packet into 0x10 packets */
+bool wire_frames(wire_packer &wire, const uint8_t *packet, int frames, int blocksize)
+{
+    const uint8_t *p = packet + 1;
+
+    for (int k = 0; k < frames; k++, p += blocksize)
+    {
+        if (!wire.add(p))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* feeder thread: queue the packets from the cache starting at frame first,
+ * or compile them as they go. A first frame inside a packet is sliced out
+ * of it into a shorter one; the packets after it go out as cached. */
+void feed(const char *movie_path, const options &opt, const packet_stream &ps, bool cached, long first, packet_queue &q)
+{
+    int blocksize = opt.fmt->databits * opt.fmt->ports * opt.fmt->lines;
+    wire_packer wire(blocksize, [&q](const uint8_t *data, int bytes, int frames) { return q.push_copy(data, bytes, frames); });
+
+    if (cached)
+    {
+        long n = first / ps.frames_per_packet;
+        int from = first % ps.frames_per_packet;
+
+        for (; n < ps.packets; n++, from = 0)
+        {
+            const uint8_t *p = ps.packet(n);
+            int bytes = ps.packet_bytes(n);
+            int frames = ps.packet_frames(n) - from;
+
+            /* take the page fault here rather than in the responder */
+            *(volatile const uint8_t *)&p[bytes - 1];
+            if (opt.rle)
+            {
+                if (!wire_frames(wire, p + from * blocksize, frames, blocksize))
+                {
+                    break;
+                }
+            }
+            else if (from > 0)
+            {
+                uint8_t part[PACKET_SIZE];
+
+                part[0] = p[0];
+                memcpy(&part[1], p + 1 + from * blocksize, frames * blocksize);
+                if (!q.push_copy(part, 1 + frames * blocksize, frames))
+                {
+                    break;
+                }
+            }
+            else if (!q.push({ p, bytes, frames }))
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        layout lay = { opt.fmt, opt.extra, opt.skip };
+        const char *cache_dir = opt.cache_dir;
+
+        /* a resumed run compiles from the frame at its latch on: blank
+         * frames first, then the movie from its skipped frames on. That
+         * is not the whole movie, so it is not kept in the cache. */
+        if (first > 0)
+        {
+            long blank = std::min(first, lay.extra);
+
+            lay.extra -= blank;
+            lay.skip += first - blank;
+            cache_dir = nullptr;
+        }
+
+        /* compiling goes on to the end after the run stops, so the cache entry is complete */
+        compile_packets(movie_path, lay, cache_dir,
+            [&q, &opt, &wire, blocksize](const uint8_t *data, int bytes, int frames)
+            {
+                if (opt.rle)
+                {
+                    wire_frames(wire, data, frames, blocksize);
+                }
+                else
+                {
+                    q.push_copy(data, bytes, frames);
+                }
+                return true;
+            });
+    }
+    if (opt.rle)
+    {
+        wire.finish();
+    }
+    q.finish();
+}
+
+/* Replies to the requests of one read, gathered and sent with one writev()
+ * straight from where the packets are queued. Packets that sit next to
+ * each other (the mapped cache, or neighbouring queue slots) share an
+ * iovec. A short packet must end its write, so anything after one goes out
+ * in the next. */
+class reply
+{
+public:
+    reply(int fd, packet_queue &q, run_stats &st)
+        : fd(fd), q(q), st(st)
+    {
+    }
+
+    /* wait for the next queued packet, false at the end of the movie */
+    bool next_ready()
+    {
+        if (taken > 0 && taken == q.ready())
+        {
+            /* let the feeder use the space before waiting on it */
+            flush();
+        }
+        return q.wait_ready(taken);
+    }
+
+    const packet_ref &next() const
+    {
+        return q.peek(taken);
+    }
+
+    void take()
+    {
+        const packet_ref &p = next();
+
+        add(p.data, p.bytes);
+        st.frames += p.frames;
+        taken++;
+    }
+
+    /* an empty 0x0F packet clears a request once the movie is out, also
+     * after 0x10 packets */
+    void add_empty()
+    {
+        static const uint8_t empty = 0x0F;
+
+        add(&empty, 1);
+    }
+
+    void flush()
+    {
+        iovec *v = iov;
+        int left = count;
+
+        while (left > 0)
+        {
+            ssize_t n = writev(fd, v, left);
+            st.writes++;
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                perror("writev");
+                exit(1);
+            }
+            for (; left > 0 && (size_t)n >= v->iov_len; v++, left--)
+            {
+                n -= v->iov_len;
+            }
+            if (left > 0)
+            {
+                v->iov_base = (uint8_t *)v->iov_base + n;
+                v->iov_len -= n;
+            }
+        }
+
+        q.pop(taken);
+        st.packets += taken;
+        taken = 0;
+        count = 0;
+        ends_short = false;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+private:
+    void add(const uint8_t *data, int bytes)
+    {
+        if (ends_short || count == MAX_IOV)
+        {
+            flush();
+        }
+        if (count > 0 && (const uint8_t *)iov[count - 1].iov_base + iov[count - 1].iov_len == data)
+        {
+            iov[count - 1].iov_len += bytes;
+        }
+        else
+        {
+            iov[count++] = { const_cast<uint8_t *>(data), (size_t)bytes };
+        }
+        ends_short = bytes < PACKET_SIZE;
+    }
+
+    static const int MAX_IOV = 64;
+
+    int fd;
+    packet_queue &q;
+    run_stats &st;
+    iovec iov[MAX_IOV];
+    int count = 0;
+    long taken = 0;
+    bool ends_short = false;
+};
+
+unsigned be(const uint8_t *p, int n)
+{
+    unsigned v = 0;
+
+    while (n--)
+    {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+void print_telemetry(const uint8_t *msg)
+{
+    printf("*** Telemetry: latch %u, underruns %u, staging misses %u, min fill %u, max ISR %u cycles, "
+        "USB turnaround max %u us avg %u us\n", be(&msg[1], 4), be(&msg[5], 4), be(&msg[9], 2),
+        be(&msg[11], 2), be(&msg[13], 2), be(&msg[15], 2), be(&msg[17], 2));
+}
+
+void print_timing(const uint8_t *msg)
+{
+    static const char *names[TIMING_SLOTS] = { "latch", "timer", "autolatch", "deferred", "usb" };
+    static const char *buckets[8] = { "<32", "<64", "<128", "<256", "<512", "<1k", "<2k", ">=2k" };
+    int slot = msg[1];
+    int k;
+
+    if (slot >= TIMING_SLOTS || be(&msg[2], 4) == 0)
+    {
+        return;
+    }
+    printf("*** Timing %-9s %8u calls %u dropped  cycles min/avg/max %u/%u/%u ", names[slot],
+        be(&msg[2], 4), be(&msg[6], 4), be(&msg[10], 4), be(&msg[14], 4), be(&msg[18], 4));
+    for (k = 0; k < 8; k++)
+    {
+        if (be(&msg[22 + 4 * k], 4))
+        {
+            printf(" %s:%u", buckets[k], be(&msg[22 + 4 * k], 4));
+        }
+    }
+    printf("\n");
+}
+
+/* ask for the ISR timing and print it, skipping whatever else the device sends meanwhile */
+void query_timing(int fd, run_stats &st)
+{
+    uint8_t msg[TIMING_BYTES];
+    int have = 0, len = 0, got = 0;
+    int c;
+
+    send_command(fd, { 0xE2, 0 }, st);
+    while (got < TIMING_SLOTS && (c = read_byte(fd, 500)) >= 0)
+    {
+        if (have == len)
+        {
+            have = 0;
+            len = message_bytes(c);
+        }
+        msg[have++] = c;
+        if (have == len && msg[0] == 0x0B)
+        {
+            print_timing(msg);
+            got++;
+        }
+    }
+}
+
+/* wait for the device's 0x0A answer, skipping whatever else it sends meanwhile */
+int flash_reply(int fd, int timeout_ms)
+{
+    uint8_t msg[TIMING_BYTES];
+    int have = 0, len = 0;
+    int c;
+
+    while ((c = read_byte(fd, timeout_ms)) >= 0)
+    {
+        if (have == len)
+        {
+            have = 0;
+            len = message_bytes(c);
+        }
+        msg[have++] = c;
+        if (have == len && msg[0] == 0x0A)
+        {
+            return (msg[1] << 8) | msg[2];
+        }
+    }
+    return FLASH_FAILED;
+}
+
+/* The image for capacity bytes of flash. A prefix for -H ends on a packet
+ * boundary, so streaming picks up with whole packets from the cache. */
+flash_image pack_for(const packet_stream &ps, const options &opt, size_t capacity)
+{
+    flash_image img = pack_image(ps, *opt.fmt, capacity, opt.flash_frames, opt.autostart);
+    long whole = img.frames - img.frames % ps.frames_per_packet;
+
+    if (opt.hybrid && img.frames < ps.frames && whole != img.frames)
+    {
+        if (whole == 0)
+        {
+            fail("no whole packet fits in flash for", "-H");
+        }
+        img = pack_image(ps, *opt.fmt, capacity, whole, opt.autostart);
+    }
+    return img;
+}
+
+/* Puts the image into the device's flash unless 0xF5 says it is there
+ * already. The 0xF1 packets go out back to back; the device holds off USB
+ * while it writes a row. Returns the image the device holds. */
+flash_image store_flash(int fd, const packet_stream &ps, const options &opt, run_stats &st)
+{
+    std::vector<uint8_t> wire;
+    flash_image img = pack_for(ps, opt, FLASH_STORE_BYTES);
+    size_t pos, len;
+    int rows;
+
+    send_command(fd, { 0xF5, img.bytes[19], img.bytes[18], img.bytes[17], img.bytes[16] }, st);
+    if (flash_reply(fd, 2000) == 0)
+    {
+        printf("+++ Device flash has the %ld frames already\n", img.frames);
+        return img;
+    }
+
+    send_command(fd, { 0xF0 }, st);
+    rows = flash_reply(fd, 2000);
+    if (rows == FLASH_FAILED)
+    {
+        printf("!!! Device can not write its flash\n");
+        exit(1);
+    }
+
+    /* a device with a store of another size */
+    if ((size_t)rows * FLASH_ROW_BYTES != FLASH_STORE_BYTES)
+    {
+        img = pack_for(ps, opt, (size_t)rows * FLASH_ROW_BYTES);
+    }
+    printf("+++ Packed %ld of %ld frames into %zu bytes of %d flash rows\n", img.frames, ps.frames,
+        img.bytes.size(), rows);
+
+    for (pos = 0; pos < img.bytes.size(); pos += len)
+    {
+        len = std::min(img.bytes.size() - pos, (size_t)PACKET_SIZE - 1);
+        wire.push_back(0xF1);
+        wire.insert(wire.end(), &img.bytes[pos], &img.bytes[pos] + len);
+    }
+
+    /* padded like the rest, so it is a whole packet even where the 0xF2
+     * after it shares a read with it; the device stores and ignores it */
+    wire.resize(((wire.size() + PACKET_SIZE - 1) / PACKET_SIZE) * PACKET_SIZE);
+    write_all(fd, wire.data(), wire.size(), st);
+
+    /* a row write takes milliseconds, the last ones may still be going */
+    send_command(fd, { 0xF2 }, st);
+    if (flash_reply(fd, 10000) == FLASH_FAILED)
+    {
+        printf("!!! Flash image did not verify on the device\n");
+        exit(1);
+    }
+    return img;
+}
+
+void report(const run_stats &st, const packet_queue &q)
+{
+    std::vector<long> lat(st.latency_ns);
+    long total = 0;
+    long limit = 1000;
+    size_t i = 0;
+
+    printf("--- %ld frames of %ld queued in %ld packets, %ld requests, %ld grants, %ld writes, queue ran dry %ld times\n",
+        st.frames, q.frames.load(), st.packets, st.requests, st.grants, st.writes, q.starved);
+    if (st.frames > 0)
+    {
+        printf("--- responder: %ld reads, %ld writes, %.2f syscalls and %.2f us CPU per frame\n",
+            st.reads, st.writes, (double)(st.reads + st.writes) / st.frames,
+            (double)st.cpu_us / st.frames);
+    }
+    if (lat.empty())
+    {
+        return;
+    }
+
+    std::sort(lat.begin(), lat.end());
+    for (long ns : lat)
+    {
+        total += ns;
+    }
+    printf("--- response latency us: min %.1f  avg %.1f  p99 %.1f  max %.1f\n",
+        lat.front() / 1000.0, (double)total / lat.size() / 1000.0,
+        lat[(lat.size() * 99) / 100] / 1000.0, lat.back() / 1000.0);
+
+    /* doubling buckets from 1 us */
+    while (i < lat.size())
+    {
+        size_t first = i;
+
+        while (i < lat.size() && (lat[i] < limit || limit >= 1024000))
+        {
+            i++;
+        }
+        if (i > first)
+        {
+            printf("    %s%5ld us %8zu  %5.1f%%\n", limit >= 1024000 ? ">=" : " <",
+                limit >= 1024000 ? limit / 2000 : limit / 1000, i - first, 100.0 * (i - first) / lat.size());
+        }
+        limit *= 2;
+    }
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-f r08|r16y|r16m] [-b] [-z] [-e frames] [-s frames] [-w period] [-o latch]\n"
+        "       [-k period] [-K latch] [-E latch:cmd[:byte[:byte]]] [-R start:end:period]\n"
+        "       [-a port:bits] [-c latch] [-t latches] [-L latch] [-T] [-v] [-C dir] <device> <movie>\n"
+        "       %s -F|-H [-z] [-f r08|r16y|r16m] [-e frames] [-s frames] [-n frames] [-A] [settings as above] <device> <movie>\n"
+        "       %s -x [-f r08|r16y|r16m] [-e frames] [-s frames] [-C dir] <movie>\n"
+        "       %s -W image [-H] [-f r08|r16y|r16m] [-e frames] [-s frames] [-n frames] [-A] [-C dir] <movie>\n"
+        "       %s -Z container <movie>\n",
+        argv0, argv0, argv0, argv0, argv0);
+    exit(1);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    options opt;
+    run_stats st;
+    packet_stream ps;
+    flash_image img;
+    packet_queue q;
+    std::thread feeder;
+    long sent, answered;
+    struct sigaction sa;
+    long credit = 0;
+    uint8_t msg[TIMING_BYTES];
+    int msg_len = 0, msg_have = 0;
+    uint8_t rx[256];
+    bool cached;
+    long t_load;
+    int fd, c;
+
+    while ((c = getopt(argc, argv, "f:bze:s:w:o:k:K:E:R:a:c:t:TvC:xFHW:n:AL:Z:")) != -1)
+    {
+        switch (c)
+        {
+            case 'f':
+                opt.fmt = find_format(optarg);
+                if (opt.fmt == nullptr)
+                {
+                    fail("unknown format", optarg);
+                }
+                break;
+            case 'b':
+                opt.credit = true;
+                break;
+            case 'z':
+                opt.rle = true;
+                break;
+            case 'e':
+                opt.extra = atol(optarg);
+                break;
+            case 's':
+                opt.skip = atol(optarg);
+                break;
+            case 'w':
+                opt.window = atol(optarg);
+                break;
+            case 'o':
+                opt.window_off = atol(optarg);
+                break;
+            case 'k':
+                opt.clock_filter = atol(optarg);
+                break;
+            case 'K':
+                /* switch off the DPCM fix on both ports */
+                opt.events.push_back({ atol(optarg), { 0xA4, 2, 0 } });
+                opt.events.push_back({ atol(optarg), { 0xB4, 2, 0 } });
+                break;
+            case 'E':
+            {
+                long latch;
+                int cmd, b1 = 0, b2 = 0;
+
+                if (sscanf(optarg, "%ld:%i:%i:%i", &latch, &cmd, &b1, &b2) < 2 || latch < 0)
+                {
+                    usage(argv[0]);
+                }
+                opt.events.push_back({ latch, { (uint8_t)cmd, (uint8_t)b1, (uint8_t)b2 } });
+                break;
+            }
+            case 'R':
+            {
+                window_range w;
+
+                if (sscanf(optarg, "%ld:%ld:%ld", &w.start, &w.end, &w.period) != 3 || w.start < 0
+                    || w.end <= w.start)
+                {
+                    usage(argv[0]);
+                }
+                opt.windows.push_back(w);
+                break;
+            }
+            case 'a':
+                if (sscanf(optarg, "%d:%d", &opt.autolatch_port, &opt.autolatch_bits) < 1)
+                {
+                    usage(argv[0]);
+                }
+                break;
+            case 'c':
+                opt.cmd_mode = atol(optarg);
+                break;
+            case 't':
+                opt.telemetry = atol(optarg);
+                break;
+            case 'T':
+                opt.timing = true;
+                break;
+            case 'v':
+                opt.verbose = true;
+                break;
+            case 'C':
+                opt.cache_dir = optarg;
+                break;
+            case 'x':
+                opt.compile_only = true;
+                break;
+            case 'F':
+                opt.flash = true;
+                break;
+            case 'H':
+                opt.flash = true;
+                opt.hybrid = true;
+                break;
+            case 'W':
+                opt.image_path = optarg;
+                opt.compile_only = true;
+                break;
+            case 'n':
+                opt.flash_frames = atol(optarg);
+                break;
+            case 'A':
+                opt.autostart = true;
+                break;
+            case 'L':
+                opt.resume = atol(optarg);
+                break;
+            case 'Z':
+                opt.seekable_path = optarg;
+                opt.compile_only = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != (opt.compile_only ? 1 : 2))
+    {
+        usage(argv[0]);
+    }
+    if (opt.events.size() + WINDOW_EVENTS * opt.windows.size() > (size_t)EVENT_SLOTS)
+    {
+        fprintf(stderr, "The device holds at most %d scheduled settings\n", EVENT_SLOTS);
+        return 1;
+    }
+    if (opt.resume < 0 || (opt.resume > 0 && opt.flash))
+    {
+        usage(argv[0]);
+    }
+
+    t_load = now_ns();
+    if (opt.seekable_path != nullptr)
+    {
+        uint64_t bytes = write_seekable(argv[optind], opt.seekable_path);
+
+        printf("+++ Wrote %llu movie bytes to %s in %.1f ms\n", (unsigned long long)bytes, opt.seekable_path,
+            (now_ns() - t_load) / 1e6);
+        return 0;
+    }
+    if (opt.compile_only)
+    {
+        ps = load_packets(argv[optind], { opt.fmt, opt.extra, opt.skip }, opt.cache_dir, cached);
+        printf("+++ %ld frames in %ld packets of %d frames, %s in %.1f ms\n", ps.frames, ps.packets,
+            ps.frames_per_packet, cached ? "cached" : "compiled", (now_ns() - t_load) / 1e6);
+        if (opt.image_path != nullptr)
+        {
+            flash_image img = pack_for(ps, opt, FLASH_STORE_BYTES);
+            FILE *f = fopen(opt.image_path, "wb");
+
+            if (f == nullptr || fwrite(img.bytes.data(), 1, img.bytes.size(), f) != img.bytes.size() || fclose(f) != 0)
+            {
+                fail("could not write", opt.image_path);
+            }
+            printf("+++ Packed %ld frames into %zu bytes\n", img.frames, img.bytes.size());
+        }
+        return 0;
+    }
+
+    if (opt.flash)
+    {
+        /* packing needs the whole movie, the feeder for -H starts once the prefix is known */
+        ps = load_packets(argv[optind + 1], { opt.fmt, opt.extra, opt.skip }, opt.cache_dir, cached);
+    }
+    else
+    {
+        /* the feeder keeps the queue full from here on, while the device is set up and during the run */
+        cached = open_packets(argv[optind + 1], { opt.fmt, opt.extra, opt.skip }, opt.cache_dir, ps);
+        if (cached)
+        {
+            printf("+++ %ld frames in %ld packets of %d frames, cached in %.1f ms\n", ps.frames, ps.packets,
+                ps.frames_per_packet, (now_ns() - t_load) / 1e6);
+            if (opt.resume >= ps.frames)
+            {
+                fprintf(stderr, "The movie ends before latch %ld\n", opt.resume);
+                return 1;
+            }
+        }
+        else if (opt.resume > 0)
+        {
+            printf("+++ Not in the packet cache, compiling from latch %ld while streaming\n", opt.resume);
+        }
+        else
+        {
+            printf("+++ Not in the packet cache, compiling while streaming\n");
+        }
+        feeder = std::thread(feed, argv[optind + 1], std::cref(opt), std::cref(ps), cached, opt.resume, std::ref(q));
+    }
+
+    fd = open_device(argv[optind]);
+
+    /* send "ping" command to make sure device is there */
+    send_command(fd, { 0xFF }, st);
+    if (read_byte(fd, 500) != 0xFF)
+    {
+        printf("!!! Device is not ready, exiting...\n");
+        return 1;
+    }
+    printf("+++ Connected to device, device is ready to receive commands...\n");
+
+    printf("--- Sending reset command to device\n");
+    send_command(fd, { 0x00 }, st);
+    usleep(100000);
+
+    if (opt.flash)
+    {
+        /* before the settings, writing flash resets the device */
+        printf("--- Writing movie to device flash\n");
+        img = store_flash(fd, ps, opt, st);
+        if (opt.hybrid)
+        {
+            feeder = std::thread(feed, argv[optind + 1], std::cref(opt), std::cref(ps), true,
+                img.frames, std::ref(q));
+        }
+        else
+        {
+            q.finish();
+        }
+    }
+
+    if (opt.window >= 0)
+    {
+        send_command(fd, { 0xA0, (uint8_t)(opt.window >> 8), (uint8_t)opt.window }, st);
+    }
+    if (opt.window_off >= 0)
+    {
+        send_command(fd, { 0xA1, (uint8_t)(opt.window_off >> 8), (uint8_t)opt.window_off }, st);
+    }
+    if (opt.clock_filter >= 0)
+    {
+        send_command(fd, { 0xA4, (uint8_t)opt.clock_filter }, st);
+        send_command(fd, { 0xB4, (uint8_t)opt.clock_filter }, st);
+    }
+    if (opt.cmd_mode >= 0)
+    {
+        send_command(fd, { 0xD0, (uint8_t)(opt.cmd_mode >> 8), (uint8_t)opt.cmd_mode }, st);
+    }
+    if (opt.autolatch_port >= 0)
+    {
+        send_command(fd, { 0xC0, 1, (uint8_t)opt.autolatch_port }, st);
+        send_command(fd, { 0xC1, (uint8_t)opt.autolatch_bits }, st);
+    }
+    send_schedule(fd, opt, st);
+    if (opt.credit)
+    {
+        send_command(fd, { 0x0E, 0x01 }, st);
+    }
+    if (opt.telemetry > 0)
+    {
+        send_command(fd, { 0xE1, (uint8_t)(opt.telemetry >> 8), (uint8_t)opt.telemetry }, st);
+    }
+
+    if (opt.hybrid)
+    {
+        /* the ring is filled from flash, nothing is preloaded */
+        printf("--- Starting playback from device flash, streaming from frame %ld\n", img.frames);
+        send_command(fd, { 0xF4, (uint8_t)(opt.window >= 0), img.bytes[19], img.bytes[18], img.bytes[17],
+            img.bytes[16] }, st);
+        if (flash_reply(fd, 5000) != 0)
+        {
+            printf("!!! Device flash does not hold the start of this movie\n");
+            return 1;
+        }
+    }
+    else if (opt.flash)
+    {
+        printf("--- Starting playback from device flash\n");
+        send_command(fd, { 0xF3, (uint8_t)(opt.window >= 0) }, st);
+        if (flash_reply(fd, 5000) != 0)
+        {
+            printf("!!! Device has no flash image to play\n");
+            return 1;
+        }
+    }
+    else if (opt.resume > 0)
+    {
+        printf("--- Sending resume command to device, at latch %ld\n", opt.resume);
+        send_command(fd, { 0x02, (uint8_t)opt.fmt->databits, (uint8_t)opt.fmt->ports,
+            (uint8_t)opt.fmt->lines, (uint8_t)(opt.window >= 0), (uint8_t)(opt.resume >> 24),
+            (uint8_t)(opt.resume >> 16), (uint8_t)(opt.resume >> 8), (uint8_t)opt.resume }, st);
+    }
+    else
+    {
+        printf("--- Sending start command to device\n");
+        send_command(fd, { 0x01, (uint8_t)opt.fmt->databits, (uint8_t)opt.fmt->ports,
+            (uint8_t)opt.fmt->lines, (uint8_t)(opt.window >= 0) }, st);
+    }
+
+    /* no SA_RESTART, so the blocking read returns on ^C */
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    printf("--- Starting read loop\n");
+    reply out(fd, q, st);
+    st.cpu_us = thread_cpu_us();
+    while (!stop)
+    {
+        long t_read, frames_before = st.frames;
+        ssize_t got;
+
+        /* blocks for at least one byte (raw mode), a signal breaks it off */
+        st.reads++;
+        got = read(fd, rx, sizeof(rx));
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            /* device gone, or the simulator finished */
+            break;
+        }
+        t_read = now_ns();
+
+        sent = st.packets;
+        answered = 0;
+        for (ssize_t r = 0; r < got; r++)
+        {
+            if (msg_have < msg_len)
+            {
+                msg[msg_have++] = rx[r];
+                if (msg_have < msg_len)
+                {
+                    continue;
+                }
+                if (msg[0] == 0x0C)
+                {
+                    print_telemetry(msg);
+                    continue;
+                }
+                if (msg[0] == 0x0B)
+                {
+                    print_timing(msg);
+                    continue;
+                }
+                if (msg[0] == 0x0A)
+                {
+                    continue;
+                }
+
+                /* whole packets only, the rest stays credited for the next grant */
+                st.grants++;
+                credit += (msg[1] << 8) | msg[2];
+                while (credit > 0 && out.next_ready() && credit >= out.next().frames)
+                {
+                    credit -= out.next().frames;
+                    out.take();
+                }
+            }
+            else if (message_bytes(rx[r]) > 1)
+            {
+                msg[0] = rx[r];
+                msg_have = 1;
+                msg_len = message_bytes(rx[r]);
+                continue;
+            }
+            else if (rx[r] == 0x0F)
+            {
+                st.requests++;
+                if (out.next_ready())
+                {
+                    out.take();
+                }
+                else
+                {
+                    out.add_empty();
+                }
+            }
+            else if (rx[r] == 0x0D)
+            {
+                printf("*** Command sent to console\n");
+                continue;
+            }
+            else
+            {
+                continue;
+            }
+            answered++;
+        }
+
+        /* everything this read asked for in one syscall */
+        if (answered > 0)
+        {
+            long ns;
+
+            if (!out.empty())
+            {
+                out.flush();
+            }
+            ns = now_ns() - t_read;
+            st.latency_ns.insert(st.latency_ns.end(), answered, ns);
+            if (opt.verbose)
+            {
+                printf("    read %ld: %ld requests, %ld packets, %.1f us\n", st.reads, answered,
+                    st.packets - sent, ns / 1000.0);
+            }
+        }
+
+        if (st.frames / 60 != frames_before / 60)
+        {
+            printf("*** Frames: [%ld]\n", st.frames);
+        }
+    }
+
+    st.cpu_us = thread_cpu_us() - st.cpu_us;
+    if (opt.timing && stop)
+    {
+        query_timing(fd, st);
+    }
+    q.close();
+    if (feeder.joinable())
+    {
+        feeder.join();
+    }
+    report(st, q);
+    close(fd);
+    return 0;
+}
+
+/* [] END OF FILE */
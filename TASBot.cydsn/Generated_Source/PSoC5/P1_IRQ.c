@@ -166,50 +166,7 @@ CY_ISR(P1_IRQ_Interrupt)
 
     /*  Place your Interrupt code here. */
     /* `#START P1_IRQ_Interrupt` */
-
-    if(autofilled == 0)
-    {
-        ConsolePort_1_RegD0_WriteRegValue(data[0]);
-        ConsolePort_1_RegD1_WriteRegValue(data[1]);
-        ConsolePort_2_RegD0_WriteRegValue(data[2]);
-        ConsolePort_2_RegD1_WriteRegValue(data[3]);
-      
-        if(playing)
-        {
-            Vis_L_Write(data[0] & 0xFF);
-            Vis_H_Write(data[0] >> 8);
-
-            Vis_L_1_Write(data[1] & 0xFF);
-            Vis_H_1_Write(data[1] >> 8);
-
-            Vis_L_2_Write(data[2] & 0xFF);
-            Vis_H_2_Write(data[2] >> 8);
-
-            Vis_L_3_Write(data[3] & 0xFF);
-            Vis_H_3_Write(data[3] >> 8);
-
-            if(!use_timer)
-            {
-                input_ptr = (input_ptr+1)%INPUT_BUF_SIZE;
-                data[0] = input[0][input_ptr]; 
-                data[1] = input[1][input_ptr]; 
-
-                data[2] = input[2][input_ptr]; 
-                data[3] = input[3][input_ptr]; 
-                
-                latches++;
-                sent = 1;
-            }
-            
-        }
-    } else {
-        autofilled = 0;
-    }
-    
-    if(autolatch)
-    {
-        ClockCounter_WriteCounter(autobits);
-    }
+    replay_latch_isr();
     /* `#END` */
 }
 
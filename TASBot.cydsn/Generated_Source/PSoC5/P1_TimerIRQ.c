@@ -165,27 +165,7 @@ CY_ISR(P1_TimerIRQ_Interrupt)
 
     /*  Place your Interrupt code here. */
     /* `#START P1_TimerIRQ_Interrupt` */
-    if(autofilled == 0)
-    {
-        if(playing && use_timer)
-        {
-            input_ptr = (input_ptr+1)%INPUT_BUF_SIZE;
-            
-            data[0] = input[0][input_ptr];        
-            data[1] = input[1][input_ptr]; 
-            data[2] = input[2][input_ptr];         
-            data[3] = input[3][input_ptr]; 
-            
-            latches++;
-            sent = 1;
-
-            if(disable_timer == 1 || latches == window_off)
-            {
-                use_timer = 0;
-                disable_timer = 0;
-            }
-        }
-    }
+    replay_timer_isr();
     /* `#END` */
 }
 
@@ -165,17 +165,7 @@ CY_ISR(WinTimer_IRQ_Interrupt)
 
     /*  Place your Interrupt code here. */
     /* `#START WinTimer_IRQ_Interrupt` */
-    if(playing && use_timer)
-    {
-        input_ptr = (input_ptr+1)%INPUT_BUF_SIZE;
-        data = input[0][input_ptr];
-        latches++;
-        if(disable_timer == 1 || latches == window_off)
-        {
-            use_timer = 0;
-            disable_timer = 0;
-        }
-    }
+    replay_timer_isr();
     /* `#END` */
 }
 
@@ -0,0 +1,248 @@
+/* ========================================
+ * Frame data unpacker
+ *
+ * One straight-line decoder per layout the 0x01
+ * command accepts, picked once when playback is
+ * configured. 16-bit lines are read as a halfword
+ * and byte swapped with REV16.
+ *
+ * The board only wires two data lines per port,
+ * so with three lines the third is skipped. The
+ * ring keeps the wired lines only, packed to
+ * databits bytes each, and a matching fetch
+ * expands a frame into the four shift register
+ * words when it is staged.
+ *
+ * Run length coded frames go through the same
+ * decoders: literal frames straight from where
+ * the tokens are, a run as the frame before it
+ * once per repeat.
+ * ========================================
+ */
+
+#include <main.h>
+#include <decode.h>
+
+#ifdef TASBOT_HOST
+#define DECODE_BE16(p) ((uint16)(((p)[0] << 8) | (p)[1]))
+#else
+/* Cortex-M3 allows unaligned LDRH; payloads start at byte 1 */
+#define DECODE_BE16(p) ((uint16)__REV16(*(const uint16 *)(const void *)(p)))
+#endif
+
+/* line k of a packet frame, counted port-major */
+#define DECODE_WORD(src, DB, k) \
+    ((DB) == 2 ? DECODE_BE16((src) + 2 * (k)) : (uint16)(src)[k])
+
+/* lines kept in the ring per port */
+#define STORED_LINES(LINES) ((LINES) > 2 ? 2 : (LINES))
+
+/* store line k of a ring frame */
+#define STORE_WORD(dst, DB, k, v) \
+    do \
+    { \
+        if ((DB) == 2) \
+        { \
+            ((uint16 *)(void *)(dst))[k] = (v); \
+        } \
+        else \
+        { \
+            (dst)[k] = (uint8)(v); \
+        } \
+    } while (0)
+
+/* line k of a ring frame as a shift register word */
+#define FETCH_WORD(src, DB, k) \
+    ((DB) == 2 ? ((const uint16 *)(const void *)(src))[k] : (uint16)((src)[k] << 8))
+
+#define DECODE_FN(name, DB, PORTS, LINES) \
+    static int name(const uint8 *src, int frames) \
+    { \
+        const int width = (DB) * (PORTS) * STORED_LINES(LINES); \
+        int ptr = buf_ptr; \
+        uint8 *dst = ring_frame(ptr); \
+        int room = ring_writable(frames); \
+        int f, p, l; \
+        if (frames > room) \
+        { \
+            frames = room; \
+        } \
+        for (f = 0; f < frames; f++) \
+        { \
+            for (p = 0; p < (PORTS); p++) \
+            { \
+                for (l = 0; l < STORED_LINES(LINES); l++) \
+                { \
+                    STORE_WORD(dst, DB, p * STORED_LINES(LINES) + l, DECODE_WORD(src, DB, p * (LINES) + l)); \
+                } \
+            } \
+            src += (DB) * (PORTS) * (LINES); \
+            ptr = ring_next(ptr); \
+            dst = (ptr == 0) ? ring_frame(0) : dst + width; \
+        } \
+        ring_publish(ptr); \
+        return frames; \
+    }
+
+#define FETCH_FN(name, DB, PORTS, LINES) \
+    static void name(volatile frame_record *dst, const uint8 *src) \
+    { \
+        uint16 p1d0 = FETCH_WORD(src, DB, 0); \
+        uint16 p1d1 = (LINES) > 1 ? FETCH_WORD(src, DB, 1) : 0; \
+        uint16 p2d0 = (PORTS) > 1 ? FETCH_WORD(src, DB, STORED_LINES(LINES)) : 0; \
+        uint16 p2d1 = (PORTS) > 1 && (LINES) > 1 ? FETCH_WORD(src, DB, STORED_LINES(LINES) + 1) : 0; \
+        dst->word[0] = (uint32)p1d0 | ((uint32)p1d1 << 16); \
+        dst->word[1] = (uint32)p2d0 | ((uint32)p2d1 << 16); \
+    }
+
+#define LAYOUT(DB, PORTS, LINES) \
+    DECODE_FN(decode_##DB##_##PORTS##_##LINES, DB, PORTS, LINES) \
+    FETCH_FN(fetch_##DB##_##PORTS##_##LINES, DB, PORTS, LINES)
+
+LAYOUT(1, 1, 1)
+LAYOUT(1, 1, 2)
+LAYOUT(1, 1, 3)
+LAYOUT(1, 2, 1)
+LAYOUT(1, 2, 2)
+LAYOUT(1, 2, 3)
+LAYOUT(2, 1, 1)
+LAYOUT(2, 1, 2)
+LAYOUT(2, 1, 3)
+LAYOUT(2, 2, 1)
+LAYOUT(2, 2, 2)
+LAYOUT(2, 2, 3)
+
+static int decode_none(const uint8 *src, int frames)
+{
+    (void) src;
+    (void) frames;
+    return 0;
+}
+
+static void fetch_none(volatile frame_record *dst, const uint8 *src)
+{
+    (void) src;
+    dst->word[0] = 0;
+    dst->word[1] = 0;
+}
+
+#define LAYOUT_TABLE(kind) \
+    { \
+        { \
+            { kind##_1_1_1, kind##_1_1_2, kind##_1_1_3 }, \
+            { kind##_1_2_1, kind##_1_2_2, kind##_1_2_3 }, \
+        }, \
+        { \
+            { kind##_2_1_1, kind##_2_1_2, kind##_2_1_3 }, \
+            { kind##_2_2_1, kind##_2_2_2, kind##_2_2_3 }, \
+        }, \
+    }
+
+/* [databits - 1][ports - 1][lines - 1] */
+static const decode_fn decoders[2][2][3] = LAYOUT_TABLE(decode);
+static const fetch_fn fetchers[2][2][3] = LAYOUT_TABLE(fetch);
+
+int layout_valid(int databits, int ports, int lines)
+{
+    return databits >= 1 && databits <= 2 && ports >= 1 && ports <= 2 && lines >= 1 && lines <= 3;
+}
+
+decode_fn decode_select(int databits, int ports, int lines)
+{
+    if (!layout_valid(databits, ports, lines))
+    {
+        return decode_none;
+    }
+    return decoders[databits - 1][ports - 1][lines - 1];
+}
+
+void rle_open(rle_state *s, decode_fn decode, int blocksize, const uint8 *src, const uint8 *end, const uint8 *prev)
+{
+    s->decode = decode;
+    s->blocksize = blocksize;
+    s->src = src;
+    s->end = end;
+    s->prev = prev;
+    s->literal = 0;
+    s->repeat = 0;
+}
+
+int rle_expand(rle_state *s)
+{
+    int room = ring_writable(1);
+    int filled = 0;
+    int n, t;
+
+    while (room > 0 && s->blocksize > 0)
+    {
+        if (s->literal > 0)
+        {
+            n = s->decode(s->src, (s->literal < room) ? s->literal : room);
+            s->src += n * s->blocksize;
+            s->prev = s->src - s->blocksize;
+            s->literal -= n;
+        }
+        else if (s->repeat > 0)
+        {
+            n = s->decode(s->prev, 1);
+            s->repeat -= n;
+        }
+        else if (s->src < s->end)
+        {
+            t = *s->src++;
+            if (!(t & RLE_RUN))
+            {
+                /* only the whole frames there are */
+                s->literal = RLE_TOKEN_FRAMES(t);
+                if (s->literal > (s->end - s->src) / s->blocksize)
+                {
+                    s->literal = (s->end - s->src) / s->blocksize;
+                    s->end = s->src + s->literal * s->blocksize;
+                }
+            }
+            else if (s->prev != NULL)
+            {
+                s->repeat = RLE_TOKEN_FRAMES(t);
+            }
+            continue;
+        }
+        else
+        {
+            break;
+        }
+
+        if (n == 0)
+        {
+            break;
+        }
+        room -= n;
+        filled += n;
+    }
+    return filled;
+}
+
+int rle_done(const rle_state *s)
+{
+    return s->literal == 0 && s->repeat == 0 && s->src >= s->end;
+}
+
+void ring_select(int databits, int ports, int lines)
+{
+    int width;
+
+    if (!layout_valid(databits, ports, lines))
+    {
+        ring_unpack = fetch_none;
+        ring_shift = 3;
+        ring_size = RING_BYTES >> 3;
+        return;
+    }
+
+    /* 1, 2, 4 or 8 bytes */
+    width = databits * ports * STORED_LINES(lines);
+    ring_shift = (width == 8) ? 3 : (width == 4) ? 2 : (width == 2) ? 1 : 0;
+    ring_size = RING_BYTES >> ring_shift;
+    ring_unpack = fetchers[databits - 1][ports - 1][lines - 1];
+}
+
+/* [] END OF FILE */
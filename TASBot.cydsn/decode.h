@@ -0,0 +1,51 @@
+/* ========================================
+ * Frame data unpacker
+ * ========================================
+ */
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <hal.h>
+
+/* Unpacks whole frames from a 0x0F payload into the replay ring, returns frames written */
+typedef int (*decode_fn)(const uint8 *src, int frames);
+
+decode_fn decode_select(int databits, int ports, int lines);
+
+/* 1 for a layout the 0x01 command accepts */
+int layout_valid(int databits, int ports, int lines);
+
+/* Run length coded frames, the token format of flash images and 0x10
+ * packets: 0x00-0x7F are followed by 1-128 literal frames in 0x0F payload
+ * layout, 0x80-0xFF repeat the frame before them 1-128 times. */
+#define RLE_RUN 0x80
+#define RLE_TOKEN_FRAMES(t) (((t) & 0x7F) + 1)
+
+typedef struct
+{
+    decode_fn decode;
+    int blocksize;
+    const uint8 *src;
+    const uint8 *end;
+    /* the frame a run repeats, NULL before the first one */
+    const uint8 *prev;
+    int literal;
+    int repeat;
+} rle_state;
+
+/* Start expanding the tokens from src up to end, runs at the start
+ * repeating prev. Tokens are trusted no further than end. */
+void rle_open(rle_state *s, decode_fn decode, int blocksize, const uint8 *src, const uint8 *end, const uint8 *prev);
+
+/* expands frames into the free ring space, returns frames written */
+int rle_expand(rle_state *s);
+
+/* 1 once every frame of the tokens is in the ring */
+int rle_done(const rle_state *s);
+
+/* Sets ring_size, ring_shift and ring_unpack for the layout, invalid ones read back all zero */
+void ring_select(int databits, int ports, int lines);
+
+#endif
+
+/* [] END OF FILE */
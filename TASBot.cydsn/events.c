@@ -0,0 +1,158 @@
+/* ========================================
+ * Latch scheduled settings
+ *
+ * The table is kept sorted as it is uploaded, so
+ * the deferred work only ever looks at the next
+ * event: event_due holds its latch and checking it
+ * is one compare per latch. Events are applied
+ * with the same code as the host commands
+ * (replay_setting), from PendSV; the table is only
+ * changed while nothing plays.
+ * ========================================
+ */
+
+#include <events.h>
+
+volatile int event_due = EVENT_NONE;
+
+typedef struct
+{
+    int latch;
+    /* command and payload, as the host would send them */
+    uint8 cmd[3];
+} event;
+
+static event table[EVENT_SLOTS];
+static int event_count = 0;
+static int event_next = 0;
+
+/* commands that can be scheduled */
+static int event_allowed(uint8 cmd)
+{
+    switch(cmd)
+    {
+        case 0xA0:
+        case 0xA1:
+        case 0xA2:
+        case 0xA3:
+        case 0xA4:
+        case 0xB4:
+        case 0xC0:
+        case 0xC1:
+        case 0xD0:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int get32(const uint8 *p)
+{
+    return (int)(((uint32)p[0] << 24) | ((uint32)p[1] << 16) | ((uint32)p[2] << 8) | p[3]);
+}
+
+/* Into its place by latch, after the events already there for the same
+ * latch, or before them with first. The caller checks for room. */
+static void event_insert(int latch, uint8 cmd, uint8 b1, uint8 b2, int first)
+{
+    int i;
+
+    for(i = event_count; i > 0 && (table[i - 1].latch > latch || (first && table[i - 1].latch == latch)); i--)
+    {
+        table[i] = table[i - 1];
+    }
+    table[i].latch = latch;
+    table[i].cmd[0] = cmd;
+    table[i].cmd[1] = b1;
+    table[i].cmd[2] = b2;
+    event_count++;
+}
+
+/* packet payload in whole entries of size bytes, at most the count in its
+ * second byte */
+static int entries(const uint8 *buf, int len, int size)
+{
+    int n = (len > 1) ? buf[1] : 0;
+
+    if(n > (len - EVENT_HEADER) / size)
+    {
+        n = (len - EVENT_HEADER) / size;
+    }
+    return n;
+}
+
+void events_add(const uint8 *buf, int len)
+{
+    const uint8 *p = buf + EVENT_HEADER;
+    int n = entries(buf, len, EVENT_BYTES);
+    int latch;
+
+    if(playing)
+    {
+        return;
+    }
+
+    /* events for the same latch apply in upload order */
+    for(; n > 0 && event_count < EVENT_SLOTS; n--, p += EVENT_BYTES)
+    {
+        latch = get32(p);
+        if(latch >= 0 && event_allowed(p[4]))
+        {
+            event_insert(latch, p[4], p[5], p[6], 0);
+        }
+    }
+    events_rewind();
+}
+
+void events_add_windows(const uint8 *buf, int len)
+{
+    const uint8 *p = buf + EVENT_HEADER;
+    int n = entries(buf, len, WINDOW_BYTES);
+    int start, end;
+
+    if(playing)
+    {
+        return;
+    }
+
+    for(; n > 0 && event_count + WINDOW_EVENTS <= EVENT_SLOTS; n--, p += WINDOW_BYTES)
+    {
+        start = get32(p);
+        end = get32(p + 4);
+        if(start < 0 || end <= start)
+        {
+            continue;
+        }
+
+        /* a range that ends where another starts closes first, so the
+         * other one keeps window mode on with its own period */
+        event_insert(start, 0xA0, p[8], p[9], 0);
+        event_insert(start, 0xA3, 0, 0, 0);
+        event_insert(end, 0xA2, 0, 0, 1);
+    }
+    events_rewind();
+}
+
+void events_clear(void)
+{
+    event_count = 0;
+    events_rewind();
+}
+
+void events_rewind(void)
+{
+    event_next = 0;
+    event_due = (event_count > 0) ? table[0].latch : EVENT_NONE;
+}
+
+void events_run(void)
+{
+    while(event_next < event_count && table[event_next].latch <= latches)
+    {
+        replay_setting(table[event_next].cmd);
+        event_next++;
+    }
+    event_due = (event_next < event_count) ? table[event_next].latch : EVENT_NONE;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,62 @@
+/* ========================================
+ * Latch scheduled settings
+ *
+ * A table of setting commands the host uploads
+ * with 0xA5 before a run, each to be applied once
+ * the replay has presented a given latch: window
+ * period and on/off, clock filter periods,
+ * autolatch and command mode. They take effect on
+ * the device at the same point 0xA1 turns window
+ * mode off, with no USB round trip in between.
+ * 0xA6 adds window mode ranges to the same table,
+ * each as the events that turn it on with its own
+ * window period and off again.
+ * ========================================
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <main.h>
+
+#define EVENT_SLOTS 64
+/* latch, command and its two payload bytes */
+#define EVENT_BYTES 7
+/* 0xA5 or 0xA6 and the entry count */
+#define EVENT_HEADER 2
+/* 0xA6 range: first latch, latch after the last one, window period */
+#define WINDOW_BYTES 10
+/* table slots a range takes */
+#define WINDOW_EVENTS 3
+
+/* latch of the next event in the table, EVENT_NONE after the last one */
+#define EVENT_NONE 0x7FFFFFFF
+extern volatile int event_due;
+
+/* 0xA5: add the events of a packet, the table stays sorted by latch */
+void events_add(const uint8 *buf, int len);
+
+/* 0xA6: add window mode ranges, [start, end) in latches */
+void events_add_windows(const uint8 *buf, int len);
+
+/* drop the table, 0x00 */
+void events_clear(void);
+
+/* back to the first event for a new run, the table stays */
+void events_rewind(void);
+
+/* apply every event up to the current latch */
+void events_run(void);
+
+/* called wherever the deferred work counts a latch, one compare unless an
+ * event is due */
+static inline void events_check(void)
+{
+    if(latches >= event_due)
+    {
+        events_run();
+    }
+}
+
+#endif
+
+/* [] END OF FILE */
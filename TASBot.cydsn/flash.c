@@ -0,0 +1,204 @@
+/* ========================================
+ * Flash movie store
+ *
+ * The store is the rows just below the metadata at
+ * the top of flash, not an array in the image: the
+ * bootloader neither checksums nor erases them, so
+ * a firmware update keeps the movie and does not
+ * carry 128 KB of zeros. They are written a row at
+ * a time through the SPC (CyFlash.c), and only if
+ * the image ends below them. An upload streams the
+ * image into a row buffer and writes each row once
+ * it is full; a row write blocks the main loop for
+ * a few milliseconds, which USB absorbs by holding
+ * off the host. Uploading is only done while
+ * nothing plays.
+ *
+ * Expanding walks the tokens from flash with the
+ * run length expander in decode.c, so literal
+ * frames are decoded straight from flash.
+ * ========================================
+ */
+
+#include <string.h>
+#include <main.h>
+#include <decode.h>
+#include <flash.h>
+
+HAL_FLASH_ROM uint8 *const flash_store = HAL_FLASH_STORE(FLASH_STORE_BYTES, FLASH_META_ROWS);
+
+volatile int flash_active = 0;
+
+static uint8 row[HAL_FLASH_ROW_BYTES] CY_ALIGN(4);
+static int row_fill = 0;
+static int rows = 0;
+static int failed = 0;
+
+static rle_state tokens;
+static int handover = 0;
+
+/* 0x0A message with a 16-bit result */
+void flash_reply(uint32 v)
+{
+    uint8 msg[FLASH_BYTES];
+
+    msg[0] = FLASH_MSG;
+    msg[1] = (v >> 8) & 0xFF;
+    msg[2] = v & 0xFF;
+    hal_usb_write(msg, FLASH_BYTES);
+}
+
+static void flash_write_row(void)
+{
+    int i;
+
+    /* past the store, the image check turns away anything that needed it */
+    if(rows >= FLASH_STORE_ROWS)
+    {
+        row_fill = 0;
+        return;
+    }
+    for(i = row_fill; i < HAL_FLASH_ROW_BYTES; i++)
+    {
+        row[i] = 0;
+    }
+    if(!hal_flash_write(&flash_store[rows * HAL_FLASH_ROW_BYTES], row))
+    {
+        failed = 1;
+    }
+    rows++;
+    row_fill = 0;
+}
+
+/* 0xF0: start writing an image from the first row, answers with the rows there are */
+void flash_upload_begin(void)
+{
+    flash_active = 0;
+    row_fill = 0;
+    rows = 0;
+    failed = !hal_flash_above_image(flash_store) || !hal_flash_start();
+
+    flash_reply(failed ? FLASH_FAILED : FLASH_STORE_ROWS);
+}
+
+/* 0xF1: the next len bytes of the image */
+void flash_upload(const uint8 *buf, int len)
+{
+    int n;
+
+    while(len > 0 && !failed)
+    {
+        n = HAL_FLASH_ROW_BYTES - row_fill;
+        if(n > len)
+        {
+            n = len;
+        }
+        memcpy(&row[row_fill], buf, n);
+        row_fill += n;
+        buf += n;
+        len -= n;
+
+        if(row_fill == HAL_FLASH_ROW_BYTES)
+        {
+            flash_write_row();
+        }
+    }
+}
+
+/* 0xF2: write the last row and check the image, answers with the rows written */
+void flash_upload_end(void)
+{
+    if(row_fill > 0 && !failed)
+    {
+        flash_write_row();
+    }
+    hal_flash_sync();
+
+    flash_reply((failed || flash_image() == NULL) ? FLASH_FAILED : (uint32)rows);
+}
+
+const flash_header *flash_image(void)
+{
+    const flash_header *img = (const flash_header *)flash_store;
+    const uint8 *p = (const uint8 *)flash_store + sizeof(flash_header);
+    const uint8 *end;
+    uint32 h = 2166136261u;
+    uint32 frames = 0;
+    int blocksize, t, n;
+
+    if(img->magic[0] != 'T' || img->magic[1] != 'A' || img->magic[2] != 'S' || img->magic[3] != 'F'
+       || img->version != FLASH_VERSION || !layout_valid(img->databits, img->ports, img->lines)
+       || img->bytes > FLASH_STORE_BYTES - sizeof(flash_header))
+    {
+        return NULL;
+    }
+    blocksize = img->databits * img->ports * img->lines;
+    end = p + img->bytes;
+
+    while(p < end)
+    {
+        h = (h ^ *p++) * 16777619u;
+    }
+    if(h != img->check)
+    {
+        return NULL;
+    }
+
+    /* the tokens have to add up to the frames and end with the data */
+    p = (const uint8 *)flash_store + sizeof(flash_header);
+    while(p < end)
+    {
+        t = *p++;
+        n = RLE_TOKEN_FRAMES(t);
+        if(t & RLE_RUN)
+        {
+            if(frames == 0)
+            {
+                return NULL;
+            }
+        }
+        else
+        {
+            p += n * blocksize;
+        }
+        frames += n;
+    }
+    if(p != end || frames == 0 || frames != img->frames)
+    {
+        return NULL;
+    }
+    return img;
+}
+
+const flash_header *flash_match(const uint8 *check)
+{
+    const flash_header *img = flash_image();
+    uint32 c = ((uint32)check[0] << 24) | ((uint32)check[1] << 16) | ((uint32)check[2] << 8) | check[3];
+
+    return (img != NULL && img->check == c) ? img : NULL;
+}
+
+void flash_open(const flash_header *img, int then_usb)
+{
+    const uint8 *src = (const uint8 *)flash_store + sizeof(flash_header);
+
+    rle_open(&tokens, decode_select(img->databits, img->ports, img->lines),
+             img->databits * img->ports * img->lines, src, src + img->bytes, NULL);
+    handover = then_usb;
+    flash_active = 1;
+}
+
+int flash_fill(void)
+{
+    int filled = rle_expand(&tokens);
+
+    /* all of it is in the ring, it drains from here or USB carries on
+     * behind it */
+    if(handover && rle_done(&tokens))
+    {
+        flash_active = 0;
+    }
+    return filled;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,94 @@
+/* ========================================
+ * Flash movie store
+ *
+ * A movie, or the opening part of one, kept in
+ * on-chip flash so it plays with no host at all.
+ * The host packs it into an image (header, then
+ * run length coded frames), uploads it with
+ * 0xF0/0xF1/0xF2 and starts it with 0xF3; an image
+ * packed to autostart also plays from power-up.
+ * 0xF4 plays the image as the prefix of a streamed
+ * run, USB refills taking over after its last
+ * frame, and 0xF5 asks whether the image is there
+ * already.
+ * While it plays the main loop expands frames from
+ * flash into the replay ring in place of USB
+ * refills, so the latch side is unchanged.
+ * ========================================
+ */
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <hal.h>
+
+/* Flash set aside for the image. The firmware takes well under half of the
+ * 256 KB, the rest is the store. */
+#ifndef FLASH_STORE_BYTES
+#define FLASH_STORE_BYTES 0x20000
+#endif
+
+/* rows at the top of flash left to the bootloadable metadata, one for each
+ * application a bootloader can hold; the store ends below them */
+#define FLASH_META_ROWS 2
+
+#define FLASH_STORE_ROWS (FLASH_STORE_BYTES / HAL_FLASH_ROW_BYTES)
+
+#define FLASH_MSG      0x0A
+/* message byte and payload, see PROTOCOL.md */
+#define FLASH_BYTES    3
+/* 0x0A payload when an upload or start failed */
+#define FLASH_FAILED   0xFFFF
+
+#define FLASH_VERSION  1
+/* header flags */
+#define FLASH_AUTOSTART 0x01
+
+/* the header is followed by run length coded frames, RLE_RUN in decode.h */
+
+/* start of the image, little-endian as the core reads it */
+typedef struct
+{
+    uint8 magic[4];
+    uint8 version;
+    uint8 databits;
+    uint8 ports;
+    uint8 lines;
+    uint32 frames;
+    /* token bytes after the header */
+    uint32 bytes;
+    /* FNV-1a of the token bytes */
+    uint32 check;
+    uint8 flags;
+    uint8 reserved[3];
+} flash_header;
+
+/* the store, FLASH_STORE_BYTES outside the application image */
+extern HAL_FLASH_ROM uint8 *const flash_store;
+
+/* the main loop is expanding frames from flash into the ring */
+extern volatile int flash_active;
+
+void flash_reply(uint32 v);
+
+/* upload, 0xF0 to 0xF2 */
+void flash_upload_begin(void);
+void flash_upload(const uint8 *buf, int len);
+void flash_upload_end(void);
+
+/* the stored image if it is whole, NULL otherwise */
+const flash_header *flash_image(void);
+
+/* the stored image if it is whole and its check is the big-endian one at check */
+const flash_header *flash_match(const uint8 *check);
+
+/* Start expanding the stored image, which flash_image has accepted. With
+ * handover, flash_active drops once the last frame is in the ring and the
+ * main loop goes on refilling from USB. */
+void flash_open(const flash_header *img, int handover);
+
+/* expand frames into the free ring space, returns frames written */
+int flash_fill(void);
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,273 @@
+/* ========================================
+ * Hardware abstraction for the replay core
+ *
+ * On the PSoC every call maps straight onto the
+ * generated component API, so nothing is added to
+ * the interrupt paths. Building with TASBOT_HOST
+ * swaps them for functions supplied by the host
+ * simulator (see Simulator/).
+ * ========================================
+ */
+#ifndef HAL_H
+#define HAL_H
+
+/* Latch triggered DMA playback (latchdma.c): 1 presents frames without the
+ * latch ISR, which needs the LatchDMA components in TopDesign; 0 leaves it
+ * out of the build. Only the simulator has run it so far, stay at 0 until
+ * it has played a movie on hardware */
+#ifndef LATCH_DMA
+#define LATCH_DMA 0
+#endif
+
+/* N64 and GameCube playback (joybus.c): 1 answers the console's polls with
+ * the joybus component from frames staged into its FIFOs, which needs the
+ * Joybus components in TopDesign; 0 leaves it out of the build */
+#ifndef JOYBUS
+#define JOYBUS 0
+#endif
+
+#ifdef TASBOT_HOST
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+
+#define CY_ALIGN(align) __attribute__ ((aligned(align)))
+
+void hal_console_write(uint16 p1d0, uint16 p1d1, uint16 p2d0, uint16 p2d1);
+void hal_vis_write(uint16 p1d0, uint16 p1d1, uint16 p2d0, uint16 p2d1);
+
+void hal_defer(void);
+
+#define hal_dmb() __sync_synchronize()
+
+uint32 hal_cycles(void);
+#define HAL_CYCLES_PER_US 72
+#define hal_cycles_start()
+
+void hal_latch_irq_start(void);
+void hal_latch_irq_stop(void);
+
+/* the latch copies stage slot 0 or 1 to the shift registers by DMA */
+void hal_latch_dma_start(const volatile void *slot0, const volatile void *slot1, int first);
+void hal_latch_dma_stop(void);
+void hal_latch_dma_stage(int slot);
+
+/* the joybus component answers polls with the last frame staged */
+void hal_joybus_start(void);
+void hal_joybus_mode(int gc);
+void hal_joybus_stage(const volatile uint16 *line);
+
+void hal_autolatch_start(void);
+void hal_autolatch_stop(void);
+void hal_autolatch_period(uint8 bits);
+void hal_autolatch_select(uint8 port);
+void hal_autolatch_reload(uint8 bits);
+void hal_autolatch_ack(void);
+
+void hal_clock_filter_period(uint8 port, uint8 period);
+void hal_window_period(uint8 port, uint16 period);
+
+int  hal_usb_configured(void);
+void hal_usb_putc(uint8 c);
+void hal_usb_write(const uint8 *buf, uint16 len);
+
+/* flash is plain memory on the host, the store a buffer in hal_host.c */
+#define HAL_FLASH_ROM
+#define HAL_FLASH_ROW_BYTES 256
+extern uint8 hal_flash_store[];
+#define HAL_FLASH_STORE(bytes, meta_rows) (hal_flash_store)
+#define hal_flash_above_image(p) 1
+int  hal_flash_start(void);
+int  hal_flash_write(const volatile uint8 *dst, const uint8 *row);
+#define hal_flash_sync()
+
+#else
+
+#include <project.h>
+
+/* ports are numbered from 0 */
+
+#define hal_console_write(p1d0, p1d1, p2d0, p2d1) \
+    do \
+    { \
+        ConsolePort_1_RegD0_WriteRegValue(p1d0); \
+        ConsolePort_1_RegD1_WriteRegValue(p1d1); \
+        ConsolePort_2_RegD0_WriteRegValue(p2d0); \
+        ConsolePort_2_RegD1_WriteRegValue(p2d1); \
+    } while (0)
+
+#define hal_vis_write(p1d0, p1d1, p2d0, p2d1) \
+    do \
+    { \
+        Vis_L_Write((p1d0) & 0xFF); \
+        Vis_H_Write((p1d0) >> 8); \
+        Vis_L_1_Write((p1d1) & 0xFF); \
+        Vis_H_1_Write((p1d1) >> 8); \
+        Vis_L_2_Write((p2d0) & 0xFF); \
+        Vis_H_2_Write((p2d0) >> 8); \
+        Vis_L_3_Write((p2d1) & 0xFF); \
+        Vis_H_3_Write((p2d1) >> 8); \
+    } while (0)
+
+/* orders ring writes against the index that publishes them */
+#define hal_dmb() __DMB()
+
+/* pend replay_deferred, it runs once the ISR that asked for it returns */
+#define hal_defer() (SCB->ICSR = SCB_ICSR_PENDSVSET_Msk)
+
+/* free running bus clock cycle count from the DWT, wraps after about a minute */
+#define hal_cycles() (DWT->CYCCNT)
+#define HAL_CYCLES_PER_US BCLK__BUS_CLK__MHZ
+
+#define hal_cycles_start() \
+    do \
+    { \
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; \
+        DWT->CYCCNT = 0; \
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; \
+    } while (0)
+
+#define hal_latch_irq_start() \
+    do \
+    { \
+        P1_IRQ_Start(); \
+        P1_TimerIRQ_Start(); \
+    } while (0)
+
+#define hal_latch_irq_stop() \
+    do \
+    { \
+        P1_IRQ_Stop(); \
+        P1_TimerIRQ_Stop(); \
+    } while (0)
+
+#if LATCH_DMA
+
+#include <latchdma.h>
+
+/* the window timer still runs from its ISR */
+#define hal_latch_dma_start(slot0, slot1, first) \
+    do \
+    { \
+        latch_dma_start(slot0, slot1, first); \
+        P1_TimerIRQ_Start(); \
+    } while (0)
+
+#define hal_latch_dma_stop() \
+    do \
+    { \
+        latch_dma_stop(); \
+        P1_TimerIRQ_Stop(); \
+    } while (0)
+
+/* the next latch runs the chain of that slot */
+#define hal_latch_dma_stage(slot) latch_dma_stage(slot)
+
+#else
+
+#define hal_latch_dma_start(slot0, slot1, first) do { } while (0)
+#define hal_latch_dma_stop() do { } while (0)
+#define hal_latch_dma_stage(slot) do { } while (0)
+
+#endif
+
+#if JOYBUS
+
+#include <joybus.h>
+
+#define hal_joybus_start()      joybus_start()
+#define hal_joybus_mode(gc)     joybus_mode(gc)
+#define hal_joybus_stage(line)  joybus_stage(line)
+
+#else
+
+#define hal_joybus_start() do { } while (0)
+#define hal_joybus_mode(gc) do { } while (0)
+#define hal_joybus_stage(line) do { } while (0)
+
+#endif
+
+#define hal_autolatch_start() \
+    do \
+    { \
+        ClockCounter_Start(); \
+        ClockCounter_IRQ_Start(); \
+    } while (0)
+
+#define hal_autolatch_stop() \
+    do \
+    { \
+        ClockCounter_Stop(); \
+        ClockCounter_IRQ_Stop(); \
+    } while (0)
+
+#define hal_autolatch_period(bits)  ClockCounter_WritePeriod(bits)
+#define hal_autolatch_select(port)  ClockCountSel_Write(port)
+#define hal_autolatch_reload(bits)  ClockCounter_WriteCounter(bits)
+#define hal_autolatch_ack()         ((void) ClockCounter_ReadStatusRegister())
+
+#define hal_clock_filter_period(port, period) \
+    ((port) == 0 ? ConsolePort_1_ClockTimer_WritePeriod(period) : ConsolePort_2_ClockTimer_WritePeriod(period))
+
+#define hal_window_period(port, period) \
+    ((port) == 0 ? ConsolePort_1_WinTimer_WritePeriod(period) : ConsolePort_2_WinTimer_WritePeriod(period))
+
+#define hal_usb_configured()  (0u != USBUART_GetConfiguration())
+
+#define hal_usb_putc(c) \
+    do \
+    { \
+        while (0u == USBUART_CDCIsReady()) { } \
+        USBUART_PutChar(c); \
+    } while (0)
+
+#define hal_usb_write(buf, len) \
+    do \
+    { \
+        while (0u == USBUART_CDCIsReady()) { } \
+        USBUART_PutData(buf, len); \
+    } while (0)
+
+/* Flash data is const and volatile, so reads are never cached across a row
+ * write. Rows are erased and written by the SPC, which needs the die
+ * temperature read first. */
+#define HAL_FLASH_ROM const volatile
+#define HAL_FLASH_ROW_BYTES CYDEV_FLS_ROW_SIZE
+
+/* bytes of flash ending meta_rows rows below the top */
+#define HAL_FLASH_STORE(bytes, meta_rows) \
+    ((HAL_FLASH_ROM uint8 *)(CYDEV_FLASH_BASE + CYDEV_FLASH_SIZE \
+                             - (meta_rows) * CYDEV_FLS_ROW_SIZE - (bytes)))
+
+/* p is past the end of the application image in flash, where the initial
+ * values of .data follow the code and constants (cm3gcc.ld) */
+#if defined(__GNUC__)
+extern const uint8 __cy_region_init_ram[];
+extern const uint8 __cy_region_init_size_ram[];
+#define hal_flash_above_image(p) \
+    ((uint32)(p) >= (uint32)__cy_region_init_ram + (uint32)__cy_region_init_size_ram)
+#else
+#define hal_flash_above_image(p) 1
+#endif
+
+#define hal_flash_start() (CYRET_SUCCESS == CySetTemp())
+
+#define hal_flash_write(dst, row) \
+    (CYRET_SUCCESS == CyWriteRowData( \
+        (uint8)(((uint32)(dst) - CYDEV_FLASH_BASE) / CYDEV_FLS_SECTOR_SIZE), \
+        (uint16)((((uint32)(dst) - CYDEV_FLASH_BASE) % CYDEV_FLS_SECTOR_SIZE) / CYDEV_FLS_ROW_SIZE), \
+        (row)))
+
+/* drop rows the flash cache may hold from before a write */
+#define hal_flash_sync() CyFlushCache()
+
+#endif
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,111 @@
+/* ========================================
+ * Joybus playback
+ *
+ * The joybus component (joybus/joybus.v) answers
+ * an N64 or GameCube console's polls by itself;
+ * the CPU only keeps the two FIFOs of its datapath
+ * filled with the frame the next poll is answered
+ * with. F0 takes bytes 0 to 3 of it, all an N64
+ * pad sends, and F1 bytes 4 to 7, the rest of a
+ * GameCube pad's.
+ *
+ * The bytes are the staged frame's shift register
+ * words, port 1 then port 2, high byte first and
+ * inverted, so a blank frame is a pad with nothing
+ * pressed and the host sends frames as it does for
+ * the shift register ports.
+ *
+ * The component pulses poll once an answer is out
+ * and the FIFOs are empty. Joybus_IRQ on it runs
+ * replay_joybus_isr, which counts it as a latch,
+ * and replay_deferred stages the next frame long
+ * before the console polls again. Staging clears
+ * the FIFOs first, so a frame staged twice between
+ * polls is still answered once.
+ *
+ * A stage can also come while the console is
+ * talking: ring_blank from replay_reset on a 0x00,
+ * or from a 0xD1 resync. Clearing the FIFOs then
+ * would cut the answer going out, so staging waits
+ * for busy to drop first. It fills the FIFOs with
+ * interrupts off right after it reads busy low; a
+ * command that starts then takes 36 us or more
+ * before the first byte is loaded. A line held low
+ * keeps busy up, so the wait gives up after the
+ * longest exchange, a GameCube poll and answer.
+ *
+ * TopDesign needs the component as Joybus, clocked
+ * at its CLOCKS_PER_US MHz with its line on an
+ * open drain pin, a control register JoybusGC on
+ * gc, a status register JoybusBusy (transparent)
+ * on busy and an isr component Joybus_IRQ on poll
+ * (rising edge); build with JOYBUS 1 once they are
+ * placed.
+ * ========================================
+ */
+
+#include <main.h>
+
+#if JOYBUS
+
+#include <Joybus_IRQ.h>
+#include <JoybusGC.h>
+#include <JoybusBusy.h>
+
+/* FIFO0_CLR and FIFO1_CLR in the datapath's auxiliary control register */
+#define JOYBUS_FIFO_CLR 0x03u
+
+/* a 0x40 command and its 8 byte answer are under 400 us */
+#define JOYBUS_BUSY_MAX_US 500
+
+void joybus_start(void)
+{
+    Joybus_IRQ_StartEx(&replay_joybus_isr);
+}
+
+void joybus_mode(int gc)
+{
+    JoybusGC_Write(gc ? 1u : 0u);
+}
+
+void joybus_stage(const volatile uint16 *line)
+{
+    uint32 start = hal_cycles();
+    uint8 intr;
+    uint8 aux;
+    uint16 w;
+    int k;
+
+    for(;;)
+    {
+        intr = CyEnterCriticalSection();
+        if(!(JoybusBusy_Read() & 1u) || hal_cycles() - start > JOYBUS_BUSY_MAX_US * HAL_CYCLES_PER_US)
+        {
+            break;
+        }
+        CyExitCriticalSection(intr);
+    }
+
+    aux = CY_GET_REG8(Joybus_dp__DP_AUX_CTL_REG);
+    CY_SET_REG8(Joybus_dp__DP_AUX_CTL_REG, aux | JOYBUS_FIFO_CLR);
+    CY_SET_REG8(Joybus_dp__DP_AUX_CTL_REG, aux);
+
+    for(k = 0; k < 2; k++)
+    {
+        w = (uint16)~line[k];
+        CY_SET_REG8(Joybus_dp__F0_REG, w >> 8);
+        CY_SET_REG8(Joybus_dp__F0_REG, w);
+    }
+    for(k = 2; k < 4; k++)
+    {
+        w = (uint16)~line[k];
+        CY_SET_REG8(Joybus_dp__F1_REG, w >> 8);
+        CY_SET_REG8(Joybus_dp__F1_REG, w);
+    }
+
+    CyExitCriticalSection(intr);
+}
+
+#endif
+
+/* [] END OF FILE */
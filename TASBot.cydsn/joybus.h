@@ -0,0 +1,20 @@
+/* ========================================
+ * Joybus playback
+ * ========================================
+ */
+#ifndef JOYBUS_H
+#define JOYBUS_H
+
+#include <project.h>
+
+/* Answer polls from here on, and which pad to answer as: 1 a GameCube
+ * pad, 0 an N64 pad. */
+void joybus_start(void);
+void joybus_mode(int gc);
+
+/* Answer the next poll with the four shift register words at line. */
+void joybus_stage(const volatile uint16 *line);
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,334 @@
+//`#start header` -- edit after this line, do not edit this line
+// ========================================
+//
+// Joybus controller side
+//
+// Answers an N64 or GameCube console on its one
+// wire, open drain, self clocked bus in UDB logic,
+// so nothing is timed by the CPU while USB streams.
+// Every bit is 4 us: the line is pulled low for
+// 1 us for a 1 or 3 us for a 0 and released for
+// the rest. The console sends a command and a stop
+// bit; once the line has been high for 4 us the
+// component answers it:
+//
+//   0x00, 0xFF  identity, 3 bytes
+//   0x01        N64 poll, 4 bytes from F0
+//   0x40 xx xx  GameCube poll, 4 bytes from F0
+//               then 4 from F1
+//   0x41, 0x42  GameCube origin, a neutral pad
+//
+// followed by a 2 us low stop bit. Anything else
+// goes unanswered.
+//
+// Poll bytes go out through one datapath: the CPU
+// writes a frame's bytes into its two FIFOs ahead
+// of the poll, and each byte is loaded into A0
+// (from F0) or A1 (from F1) and shifted out MSB
+// first, one shift per bit cell. Identity and
+// origin are constants and come from the control
+// logic. Once a poll's stop bit is out poll pulses
+// for one clock. It stands in for the latch of the
+// shift register ports: it goes to Joybus_IRQ and
+// the CPU stages the next frame into the emptied
+// FIFOs before the console polls again (joybus.c).
+//
+// Wiring: clk at CLOCKS_PER_US MHz (2 or more),
+// line_in from and line_out to the same pin, set to
+// open drain drives low, gc from a control
+// register, busy to a status register. busy is up
+// from a command's first falling edge until the
+// answer's stop bit is out; the CPU does not touch
+// the FIFOs while it is (joybus.c).
+//
+// ========================================
+`include "cypress.v"
+//`#end` -- edit above this line, do not edit this line
+// Component: joybus
+module joybus (
+	output  line_out,
+	output  reg poll,
+	output  busy,
+	input   clk,
+	input   line_in,
+	input   gc
+);
+	parameter CLOCKS_PER_US = 8;
+
+//`#start body` -- edit after this line, do not edit this line
+    localparam IDLE = 0;
+    localparam LOW = 1;
+    localparam HIGH = 2;
+    localparam SEND = 3;
+    localparam STOP = 4;
+
+    localparam ID = 0;
+    localparam ORIGIN = 1;
+    localparam DATA = 2;
+
+    /* datapath operations, the cs_addr of each CFGRAM word below */
+    localparam DP_IDLE = 3'd0;
+    localparam DP_LOAD0 = 3'd1;
+    localparam DP_SHIFT0 = 3'd2;
+    localparam DP_LOAD1 = 3'd3;
+    localparam DP_SHIFT1 = 3'd4;
+
+    localparam US = CLOCKS_PER_US;
+
+    /* line_in is asynchronous, the third stage finds the falling edge */
+    reg [2:0] sync;
+    wire line = sync[1];
+    wire fall = sync[2] & ~sync[1];
+
+    reg [2:0] state;
+    /* clocks into the current low, high or bit cell */
+    reg [9:0] t;
+    /* first byte of the command and the bits so far, stop bit included */
+    reg [7:0] cmd;
+    reg [5:0] nbits;
+
+    reg [1:0] kind;
+    /* bit of the response on the wire and the last one */
+    reg [6:0] idx;
+    reg [6:0] last;
+    /* its value, taken at the second clock of its cell */
+    reg out_bit;
+    reg drive;
+
+    /* identity: 05 00 02 for an N64 pad without a pak, 09 00 03 for a
+     * GameCube pad; origin: 00, five times 80, four times 00 */
+    wire [7:0] id_byte = (idx[6:3] == 0) ? (gc ? 8'h09 : 8'h05) :
+                         (idx[6:3] == 2) ? (gc ? 8'h03 : 8'h02) : 8'h00;
+    wire id_bit = id_byte[~idx[2:0]];
+    wire origin_bit = (idx[2:0] == 0) && (idx[6:3] >= 1) && (idx[6:3] <= 5);
+
+    /* poll bytes 4 to 7 come through A1 */
+    wire hi = idx[5];
+    wire shifting = (state == SEND) && (kind == DATA);
+    wire [2:0] cs_addr = !shifting ? DP_IDLE :
+                         (t == 0 && idx[2:0] == 0) ? (hi ? DP_LOAD1 : DP_LOAD0) :
+                         (t == 1) ? (hi ? DP_SHIFT1 : DP_SHIFT0) : DP_IDLE;
+    wire so;
+
+    assign line_out = ~drive;
+    assign busy = (state != IDLE);
+
+    always @ (posedge clk)
+    begin
+        sync <= {sync[1:0], line_in};
+        poll <= 0;
+        /* every cell starts low for 1 us whatever the bit, so out_bit is
+         * only looked at once it is taken */
+        drive <= (state == SEND && t < (out_bit ? US : 3 * US)) || (state == STOP && t < 2 * US);
+
+        case(state)
+            IDLE:
+                begin
+                    if(fall)
+                    begin
+                        cmd <= 0;
+                        nbits <= 0;
+                        t <= 0;
+                        state <= LOW;
+                    end
+                end
+            LOW:
+                begin
+                    if(line)
+                    begin
+                        /* a 1 is low for 1 us, a 0 for 3 */
+                        if(nbits < 8)
+                        begin
+                            cmd <= {cmd[6:0], t < 2 * US};
+                        end
+                        if(nbits != 63)
+                        begin
+                            nbits <= nbits + 1;
+                        end
+                        t <= 0;
+                        state <= HIGH;
+                    end
+                    else if(t != 1023)
+                    begin
+                        t <= t + 1;
+                    end
+                end
+            HIGH:
+                begin
+                    if(fall)
+                    begin
+                        t <= 0;
+                        state <= LOW;
+                    end
+                    else if(t == 4 * US)
+                    begin
+                        t <= 0;
+                        idx <= 0;
+                        state <= SEND;
+                        if(nbits == 9 && (cmd == 8'h00 || cmd == 8'hFF))
+                        begin
+                            kind <= ID;
+                            last <= 23;
+                        end
+                        else if(nbits == 9 && !gc && cmd == 8'h01)
+                        begin
+                            kind <= DATA;
+                            last <= 31;
+                        end
+                        else if(nbits == 25 && gc && cmd == 8'h40)
+                        begin
+                            kind <= DATA;
+                            last <= 63;
+                        end
+                        else if(nbits == 9 && gc && (cmd == 8'h41 || cmd == 8'h42))
+                        begin
+                            kind <= ORIGIN;
+                            last <= 79;
+                        end
+                        else
+                        begin
+                            state <= IDLE;
+                        end
+                    end
+                    else
+                    begin
+                        t <= t + 1;
+                    end
+                end
+            SEND:
+                begin
+                    if(t == 1)
+                    begin
+                        out_bit <= (kind == DATA) ? so : (kind == ID) ? id_bit : origin_bit;
+                    end
+                    if(t == 4 * US - 1)
+                    begin
+                        t <= 0;
+                        if(idx == last)
+                        begin
+                            state <= STOP;
+                        end
+                        else
+                        begin
+                            idx <= idx + 1;
+                        end
+                    end
+                    else
+                    begin
+                        t <= t + 1;
+                    end
+                end
+            STOP:
+                begin
+                    /* released, the line comes back up without a falling edge */
+                    if(t == 2 * US)
+                    begin
+                        poll <= (kind == DATA);
+                        state <= IDLE;
+                    end
+                    else
+                    begin
+                        t <= t + 1;
+                    end
+                end
+        endcase
+    end
+
+    /* F0 and F1 are written by the CPU. A load takes the next byte of a
+     * FIFO into its accumulator, a shift moves the accumulator left
+     * through the ALU and so is the bit shifted out. */
+    cy_psoc3_dp #(.cy_dpconfig(
+    {
+        `CS_ALU_OP_PASS, `CS_SRCA_A0, `CS_SRCB_D0,
+        `CS_SHFT_OP_PASS, `CS_A0_SRC_NONE, `CS_A1_SRC_NONE,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM0: idle */
+        `CS_ALU_OP_PASS, `CS_SRCA_A0, `CS_SRCB_D0,
+        `CS_SHFT_OP_PASS, `CS_A0_SRC___F0, `CS_A1_SRC_NONE,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM1: A0 <- F0 */
+        `CS_ALU_OP_PASS, `CS_SRCA_A0, `CS_SRCB_D0,
+        `CS_SHFT_OP___SL, `CS_A0_SRC__ALU, `CS_A1_SRC_NONE,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM2: A0 <- A0 << 1 */
+        `CS_ALU_OP_PASS, `CS_SRCA_A1, `CS_SRCB_D0,
+        `CS_SHFT_OP_PASS, `CS_A0_SRC_NONE, `CS_A1_SRC___F1,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM3: A1 <- F1 */
+        `CS_ALU_OP_PASS, `CS_SRCA_A1, `CS_SRCB_D0,
+        `CS_SHFT_OP___SL, `CS_A0_SRC_NONE, `CS_A1_SRC__ALU,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM4: A1 <- A1 << 1 */
+        `CS_ALU_OP_PASS, `CS_SRCA_A0, `CS_SRCB_D0,
+        `CS_SHFT_OP_PASS, `CS_A0_SRC_NONE, `CS_A1_SRC_NONE,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM5: idle */
+        `CS_ALU_OP_PASS, `CS_SRCA_A0, `CS_SRCB_D0,
+        `CS_SHFT_OP_PASS, `CS_A0_SRC_NONE, `CS_A1_SRC_NONE,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM6: idle */
+        `CS_ALU_OP_PASS, `CS_SRCA_A0, `CS_SRCB_D0,
+        `CS_SHFT_OP_PASS, `CS_A0_SRC_NONE, `CS_A1_SRC_NONE,
+        `CS_FEEDBACK_DSBL, `CS_CI_SEL_CFGA, `CS_SI_SEL_CFGA,
+        `CS_CMP_SEL_CFGA, /*CFGRAM7: idle */
+        8'hFF, 8'h00, /*CFG9: */
+        8'hFF, 8'hFF, /*CFG11-10: */
+        `SC_CMPB_A1_D1, `SC_CMPA_A1_D1, `SC_CI_B_ARITH,
+        `SC_CI_A_ARITH, `SC_C1_MASK_DSBL, `SC_C0_MASK_DSBL,
+        `SC_A_MASK_DSBL, `SC_DEF_SI_0, `SC_SI_B_DEFSI,
+        `SC_SI_A_DEFSI, /*CFG13-12: */
+        `SC_A0_SRC_ACC, `SC_SHIFT_SL, 1'h0,
+        1'h0, `SC_FIFO1_BUS, `SC_FIFO0_BUS,
+        `SC_MSB_DSBL, `SC_MSB_BIT0, `SC_MSB_NOCHN,
+        `SC_FB_NOCHN, `SC_CMP1_NOCHN,
+        `SC_CMP0_NOCHN, /*CFG15-14: */
+        10'h00, `SC_FIFO_CLK__DP, `SC_FIFO_CAP_AX,
+        `SC_FIFO_LEVEL, `SC_FIFO__SYNC, `SC_EXTCRC_DSBL,
+        `SC_WRK16CAT_DSBL /*CFG17-16: */
+    })) dp(
+        /* input */ .reset(1'b0),
+        /* input */ .clk(clk),
+        /* input [02:00] */ .cs_addr(cs_addr),
+        /* input */ .route_si(1'b0),
+        /* input */ .route_ci(1'b0),
+        /* input */ .f0_load(1'b0),
+        /* input */ .f1_load(1'b0),
+        /* input */ .d0_load(1'b0),
+        /* input */ .d1_load(1'b0),
+        /* output */ .ce0(),
+        /* output */ .cl0(),
+        /* output */ .z0(),
+        /* output */ .ff0(),
+        /* output */ .ce1(),
+        /* output */ .cl1(),
+        /* output */ .z1(),
+        /* output */ .ff1(),
+        /* output */ .ov_msb(),
+        /* output */ .co_msb(),
+        /* output */ .cmsb(),
+        /* output */ .so(so),
+        /* output */ .f0_bus_stat(),
+        /* output */ .f0_blk_stat(),
+        /* output */ .f1_bus_stat(),
+        /* output */ .f1_blk_stat()
+    );
+
+    initial begin
+        sync <= 3'b111;
+        state <= IDLE;
+        t <= 0;
+        cmd <= 0;
+        nbits <= 0;
+        kind <= ID;
+        idx <= 0;
+        last <= 0;
+        out_bit <= 0;
+        drive <= 0;
+        poll <= 0;
+    end
+
+//`#end` -- edit above this line, do not edit this line
+endmodule
+//`#start footer` -- edit after this line, do not edit this line
+
+//`#end` -- edit above this line, do not edit this line
@@ -0,0 +1,134 @@
+/* ========================================
+ * Latch triggered DMA playback
+ *
+ * Presents the staged frame with no ISR in the
+ * way: the P1 latch is the hardware request of a
+ * DMA channel, and its TD chain copies the four
+ * shift register words of a stage slot into the
+ * ConsolePort_1/2 RegD0/RegD1 registers, a 16-bit
+ * burst each. The chain is the same few PHUB
+ * transfers on every latch, so the console finds
+ * its data after a fixed delay however busy the
+ * CPU is.
+ *
+ * Each stage slot has a looping chain of four
+ * TDs. The first three run the next one without
+ * another request; the last goes back to the first
+ * and raises nrq, whose ISR counts the latch and
+ * pends the deferred work as the latch ISR does.
+ * Staging a frame points the channel at the chain
+ * of its slot. The initial TD may only be set on
+ * a disabled channel, so latch_dma_stage waits
+ * for the chain to finish, then disables, points
+ * and enables the channel again with interrupts
+ * off. A latch in those few cycles is not lost:
+ * the drq stays pending on the disabled channel
+ * (which is why latch_dma_start clears it) and
+ * runs the new chain when it is enabled again.
+ *
+ * Not yet run on hardware, keep LATCH_DMA 0 in
+ * builds for a run until it has been.
+ *
+ * TopDesign needs a DMA component LatchDMA with
+ * its drq on the P1 latch net (hardware request,
+ * rising edge) and an isr component LatchDMA_IRQ
+ * on its nrq; build with LATCH_DMA 1 once they are
+ * placed.
+ * ========================================
+ */
+
+#include <main.h>
+
+#if LATCH_DMA
+
+#include <LatchDMA_dma.h>
+#include <LatchDMA_IRQ.h>
+
+#define LATCH_DMA_WORDS 4
+/* one shift register word per burst, the whole TD on one request */
+#define LATCH_DMA_BURST 2
+
+static uint8 latch_dma_ch = CY_DMA_INVALID_CHANNEL;
+static uint8 latch_dma_td[2];
+
+void latch_dma_start(const volatile void *slot0, const volatile void *slot1, int first)
+{
+    reg16 *regs[LATCH_DMA_WORDS] =
+    {
+        ConsolePort_1_RegD0_SHIFT_REG_LSB_PTR,
+        ConsolePort_1_RegD1_SHIFT_REG_LSB_PTR,
+        ConsolePort_2_RegD0_SHIFT_REG_LSB_PTR,
+        ConsolePort_2_RegD1_SHIFT_REG_LSB_PTR,
+    };
+    const volatile uint16 *src[2];
+    uint8 td[LATCH_DMA_WORDS];
+    int s, k;
+
+    src[0] = (const volatile uint16 *)slot0;
+    src[1] = (const volatile uint16 *)slot1;
+
+    /* channel and TDs are set up once and kept over resets; the slots
+     * share the upper half of their address, stage is aligned for it */
+    if(latch_dma_ch == CY_DMA_INVALID_CHANNEL)
+    {
+        latch_dma_ch = LatchDMA_DmaInitialize(LATCH_DMA_BURST, 0, HI16((uint32)slot0), HI16(CYDEV_PERIPH_BASE));
+
+        for(s = 0; s < 2; s++)
+        {
+            for(k = 0; k < LATCH_DMA_WORDS; k++)
+            {
+                td[k] = CyDmaTdAllocate();
+            }
+            for(k = 0; k < LATCH_DMA_WORDS - 1; k++)
+            {
+                (void) CyDmaTdSetConfiguration(td[k], LATCH_DMA_BURST, td[k + 1], CY_DMA_TD_AUTO_EXEC_NEXT);
+                (void) CyDmaTdSetAddress(td[k], LO16((uint32)&src[s][k]), LO16((uint32)regs[k]));
+            }
+            (void) CyDmaTdSetConfiguration(td[k], LATCH_DMA_BURST, td[0], LatchDMA__TD_TERMOUT_EN);
+            (void) CyDmaTdSetAddress(td[k], LO16((uint32)&src[s][k]), LO16((uint32)regs[k]));
+            latch_dma_td[s] = td[0];
+        }
+    }
+
+    /* a latch seen while stopped does not run */
+    (void) CyDmaClearPendingDrq(latch_dma_ch);
+    (void) CyDmaChSetInitialTd(latch_dma_ch, latch_dma_td[first]);
+    (void) CyDmaChEnable(latch_dma_ch, 1u);
+
+    LatchDMA_IRQ_StartEx(&replay_latch_dma_isr);
+}
+
+void latch_dma_stage(int slot)
+{
+    uint8 td, state;
+    uint8 intr;
+
+    intr = CyEnterCriticalSection();
+
+    /* a latch that came in while PendSV was getting here may still be
+     * running the chain; let it present the old slot whole */
+    do
+    {
+        (void) CyDmaChStatus(latch_dma_ch, &td, &state);
+    } while(state & CY_DMA_STATUS_CHAIN_ACTIVE);
+
+    (void) CyDmaChDisable(latch_dma_ch);
+    (void) CyDmaChSetInitialTd(latch_dma_ch, latch_dma_td[slot]);
+    (void) CyDmaChEnable(latch_dma_ch, 1u);
+
+    CyExitCriticalSection(intr);
+}
+
+void latch_dma_stop(void)
+{
+    LatchDMA_IRQ_Stop();
+
+    if(latch_dma_ch != CY_DMA_INVALID_CHANNEL)
+    {
+        (void) CyDmaChDisable(latch_dma_ch);
+    }
+}
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,20 @@
+/* ========================================
+ * Latch triggered DMA playback
+ * ========================================
+ */
+#ifndef LATCHDMA_H
+#define LATCHDMA_H
+
+#include <project.h>
+
+/* Copy slot0 or slot1, four shift register words each, to the console
+ * ports on every P1 latch, starting with slot first. */
+void latch_dma_start(const volatile void *slot0, const volatile void *slot1, int first);
+void latch_dma_stop(void);
+
+/* Run the chain of slot from the next latch on. */
+void latch_dma_stage(int slot);
+
+#endif
+
+/* [] END OF FILE */
@@ -9,32 +9,123 @@
  *
  * ========================================
 */
-#include <project.h>
-
-#define INPUT_BUF_SIZE 4096
-
-volatile int sent;
-volatile int playing;
-volatile int input_ptr;
-volatile int buf_ptr;
-volatile uint16 data[4];
-volatile uint16 input[4][INPUT_BUF_SIZE];
-volatile int ready;
-volatile int timer_ready;
-volatile int use_timer;
-volatile int disable_timer;
-volatile int bytes;
-volatile int window_off;
-volatile int latches;
-volatile int ports;
-volatile int lines;
-volatile int request;
-volatile int autolatch;
-volatile int autofilled;
-volatile int autobits;
-
-volatile int cmd_mode_start;
-volatile int cmd_mode_no_data;
-volatile int cmd_mode_cmd_sent;
+#ifndef MAIN_H
+#define MAIN_H
+
+#include <hal.h>
+#include <usbin.h>
+#include <ring.h>
+#include <flash.h>
+
+/* LED visualization: 1 mirrors each presented frame and writes the Vis_*
+ * registers from the main loop, 0 leaves it out of the build */
+#ifndef VIS_ENABLE
+#define VIS_ENABLE 1
+#endif
+
+/* smallest refill grant in frames, keeps the host from being asked for a frame at a time */
+#define CREDIT_MIN_GRANT 64
+
+typedef union
+{
+    uint16 line[4];
+    uint32 word[2];
+} frame_record;
+
+/* expands one packed ring frame into a frame_record */
+typedef void (*fetch_fn)(volatile frame_record *dst, const uint8 *src);
+
+extern volatile int sent;
+extern volatile int playing;
+/* two next-frame slots, latches present *data while the other one is filled */
+extern volatile frame_record stage[2];
+extern volatile frame_record *volatile data;
+extern volatile int latched;
+extern volatile int stage_misses;
+/* expands a ring frame of the session's layout, set by ring_select */
+extern volatile fetch_fn ring_unpack;
+extern volatile int ready;
+extern volatile int timer_ready;
+extern volatile int use_timer;
+extern volatile int disable_timer;
+extern volatile int bytes;
+extern volatile int window_off;
+extern volatile int latches;
+extern volatile int ports;
+extern volatile int lines;
+extern volatile int databits;
+extern volatile int request;
+extern volatile int autolatch;
+extern volatile int autofilled;
+extern volatile int autobits;
+
+extern volatile int cmd_mode_start;
+extern volatile int cmd_mode_no_data;
+extern volatile int cmd_mode_cmd_sent;
+
+extern volatile int credit_mode;
+extern volatile int credit;
+
+extern volatile int vis_enabled;
+
+/* the slot the latch ISR is not presenting from */
+#define STAGE_FREE() ((data == &stage[0]) ? &stage[1] : &stage[0])
+
+/* present all buttons released from the next latch */
+static inline void ring_blank(void)
+{
+    volatile frame_record *next = STAGE_FREE();
+
+    next->word[0] = 0xFFFFFFFF;
+    next->word[1] = 0xFFFFFFFF;
+    data = next;
+    hal_latch_dma_stage(next == &stage[1]);
+    if(JOYBUS)
+    {
+        hal_joybus_stage(next->line);
+    }
+}
+
+/* load the frame at ring position ptr into the free slot and present it
+ * from the next latch, all buttons released for the -1 of a dropped ring */
+static inline void ring_fetch(int ptr)
+{
+    volatile frame_record *next;
+
+    if(ptr < 0)
+    {
+        ring_blank();
+        return;
+    }
+
+    next = STAGE_FREE();
+    /* the frame is not being written while it is between input_ptr and buf_ptr */
+    ring_unpack(next, ring_frame(ptr));
+    data = next;
+    hal_latch_dma_stage(next == &stage[1]);
+    if(JOYBUS)
+    {
+        hal_joybus_stage(next->line);
+    }
+}
+
+/* replay core, replay.c */
+void replay_reset(void);
+void replay_step(void);
+void replay_command(usbin_packet *pkt);
+void replay_setting(const uint8 *buffer);
+void replay_play_flash(const flash_header *img, int timer, int handover);
+
+/* interrupt entry points, called from the generated ISRs */
+void replay_latch_isr(void);
+void replay_latch_dma_isr(void);
+void replay_joybus_isr(void);
+void replay_timer_isr(void);
+void replay_autolatch_isr(void);
+
+/* deferred half of the latch, window timer and autolatch ISRs, runs from PendSV */
+void replay_deferred(void);
+
+#endif
 
 /* [] END OF FILE */
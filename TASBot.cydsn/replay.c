@@ -0,0 +1,990 @@
+/* ========================================
+ * TAS NES/NES Replay Device for the PSoC5
+ *
+ * Replay core: command handling, ring refill and
+ * the latch/timer/autolatch interrupt bodies. All
+ * hardware access goes through hal.h so this file
+ * also builds for the host simulator.
+ *
+ * The latch, window timer and autolatch ISRs only
+ * load the shift registers from the staged frame
+ * and count what happened. Advancing the ring, the
+ * window-off and command mode bookkeeping and
+ * staging the following frame happen in
+ * replay_deferred, pended to PendSV, so the next
+ * latch finds its frame ready, and so are the
+ * settings scheduled for a latch (events.c).
+ * Built with LATCH_DMA the latch does not even
+ * need its ISR: DMA loads the shift registers
+ * (latchdma.c) and only the counting is left to an
+ * interrupt. Built with JOYBUS an N64 or GameCube
+ * console's polls take the place of the latch: the
+ * joybus component answers them from the frame
+ * staged into its FIFOs (joybus.c) and interrupts
+ * once it has.
+ *
+ * 0x10 packets carry run length coded frames, which
+ * can be many more than the ring has room for. Such
+ * a packet is copied out of the staging ring and
+ * expanded by the main loop as the ring drains;
+ * frame data behind it waits, and nothing more is
+ * asked for meanwhile.
+ *
+ * The LED visualization is fed from a mirror of the
+ * presented frame by the main loop, no interrupt
+ * touches the Vis_* registers.
+ * ========================================
+ */
+
+#include <string.h>
+#include <main.h>
+#include <decode.h>
+#include <flash.h>
+#include <telemetry.h>
+#include <timing.h>
+#include <events.h>
+
+volatile int sent = 0;
+volatile int playing = 0;
+/* aligned so both slots share the upper half of their address, for latchdma.c */
+volatile frame_record stage[2] CY_ALIGN(16);
+volatile frame_record *volatile data = &stage[0];
+volatile int latched = 0;
+volatile int stage_misses = 0;
+/* word aligned halves never straddle the SRAM_L/SRAM_U boundary */
+volatile uint8 input[RING_BYTES] CY_ALIGN(8);
+volatile int ring_size = RING_BYTES >> 3;
+volatile int ring_shift = 3;
+volatile fetch_fn ring_unpack;
+volatile int input_ptr = 0;
+volatile int buf_ptr = 0;
+int ring_tail_seen = 0;
+int ring_head_seen = 0;
+volatile int ring_underruns = 0;
+int ring_dropped = 0;
+volatile int count = 0;
+volatile int ready = 0;
+volatile int timer_ready = 0;
+volatile int use_timer = 0;
+volatile int ports = 0;
+volatile int lines = 0;
+volatile int databits = 0;
+volatile int request = 0;
+volatile int disable_timer = 0;
+volatile int bytes = 0;
+volatile int window_off = -1;
+volatile int latches = 0;
+volatile int autolatch = 0;
+volatile int autofilled = 0;
+volatile int autobits = 16;
+
+volatile int cmd_mode_start = -1;
+volatile int cmd_mode_no_data = 0;
+volatile int cmd_mode_cmd_sent = 0;
+
+volatile int credit_mode = 0;
+volatile int credit = 0;
+
+volatile int vis_enabled = VIS_ENABLE;
+#if VIS_ENABLE
+static volatile frame_record vis_frame;
+static frame_record vis_shown;
+#endif
+
+static int blocksize = 0;
+static decode_fn decode;
+static int deferred_seen = 0;
+
+/* window timeouts and autolatches for replay_deferred, as latched is for
+ * latches */
+static volatile int timed = 0;
+static volatile int autolatched = 0;
+static int timed_seen = 0;
+/* the last latch moved the ring on by itself, so the window it opened does
+ * not; it was the one that turned window mode on */
+static volatile int latch_advanced = 0;
+static int autolatched_seen = 0;
+/* 0xD1 came: input_ptr is the latch path's, so replay_deferred moves it */
+static volatile int ring_resync = 0;
+
+/* the 0x10 packet being expanded, and the frame a run at the start of the
+ * next one repeats */
+static rle_state wire;
+static uint8 wire_buf[USBIN_PACKET_SIZE];
+static uint8 wire_last[USBIN_PACKET_SIZE];
+static int wire_pending = 0;
+
+/* copy the frame being presented for the main loop to show */
+static inline void vis_mirror(void)
+{
+#if VIS_ENABLE
+    if(vis_enabled)
+    {
+        vis_frame.word[0] = data->word[0];
+        vis_frame.word[1] = data->word[1];
+    }
+#endif
+}
+
+/* main loop side of the visualization, writes only when the frame changed */
+static void vis_update(void)
+{
+#if VIS_ENABLE
+    frame_record f;
+
+    if(!vis_enabled)
+    {
+        return;
+    }
+
+    f.word[0] = vis_frame.word[0];
+    f.word[1] = vis_frame.word[1];
+
+    /* mirrored again while copying, pick it up next pass */
+    if(f.word[0] != vis_frame.word[0] || f.word[1] != vis_frame.word[1])
+    {
+        return;
+    }
+
+    if(f.word[0] != vis_shown.word[0] || f.word[1] != vis_shown.word[1])
+    {
+        hal_vis_write(f.line[0], f.line[1], f.line[2], f.line[3]);
+        vis_shown = f;
+    }
+#endif
+}
+
+/* layout and counters for a new run, from 0x01 or the flash image */
+static void replay_configure(int db, int p, int l, int timer)
+{
+    databits = db;
+    ports = p;
+    lines = l;
+    use_timer = timer;
+
+    playing = 0;
+    input_ptr = 0;
+    buf_ptr = 0;
+    ring_tail_seen = 0;
+    ring_head_seen = 0;
+    ring_underruns = 0;
+    ring_dropped = 0;
+    sent = 0;
+    count = 0;
+    latches = 0;
+    latched = 0;
+    deferred_seen = 0;
+    timed = 0;
+    timed_seen = 0;
+    latch_advanced = 0;
+    autolatched = 0;
+    autolatched_seen = 0;
+    ring_resync = 0;
+    stage_misses = 0;
+    autofilled = 0;
+    flash_active = 0;
+    events_rewind();
+
+    blocksize = ports * databits * lines;
+    decode = decode_select(databits, ports, lines);
+    ring_select(databits, ports, lines);
+
+    rle_open(&wire, decode, blocksize, wire_buf, wire_buf, NULL);
+    wire_pending = 0;
+}
+
+/* Take a 0x10 packet out of the staging ring and start expanding it. The
+ * byte after the command is the token count, so the host can pad packets
+ * to 64 bytes and send them back to back. */
+static void wire_open(const uint8 *buffer, int len)
+{
+    const uint8 *prev = NULL;
+    int n = (len > 2) ? buffer[1] : 0;
+
+    if(n > len - 2)
+    {
+        n = len - 2;
+    }
+    if(wire.prev != NULL)
+    {
+        memmove(wire_last, wire.prev, blocksize);
+        prev = wire_last;
+    }
+    memcpy(wire_buf, buffer + 2, n);
+    rle_open(&wire, decode, blocksize, wire_buf, wire_buf + n, prev);
+    wire_pending = 1;
+}
+
+/* expand what fits of the 0x10 packet, the next request once it is all in */
+static void wire_expand(void)
+{
+    credit -= rle_expand(&wire);
+    if(credit < 0)
+    {
+        credit = 0;
+    }
+    if(rle_done(&wire))
+    {
+        wire_pending = 0;
+        request = 0;
+    }
+}
+
+/* present the first frame of the filled ring and start taking latches */
+static void replay_begin(void)
+{
+    /* settings scheduled up to the first latch are in place for it, a
+     * resumed run starts with window mode as they left it */
+    events_check();
+    if(disable_timer || (window_off >= 0 && latches >= window_off))
+    {
+        use_timer = 0;
+        disable_timer = 0;
+    }
+
+    ring_fetch(0);
+
+    hal_console_write(data->line[0], data->line[1], data->line[2], data->line[3]);
+
+    telemetry_reset();
+    timing_reset();
+
+    timer_ready = 1;
+    ready = 1;
+    playing = 1;
+    request = 0;
+    credit = 0;
+
+    /* a joybus console's polls are its latches; an autolatch serves the
+     * console latch after it, which the DMA would present again, so those
+     * runs keep the latch ISR */
+    if(JOYBUS)
+    {
+        /* two ports' lines are the 8 bytes of a GameCube pad, one port's
+         * the 4 of an N64 pad */
+        hal_joybus_mode(ports > 1);
+    }
+    else if(LATCH_DMA && !autolatch)
+    {
+        hal_latch_dma_start(&stage[0], &stage[1], data == &stage[1]);
+    }
+    else
+    {
+        hal_latch_irq_start();
+    }
+
+    if(autolatch)
+    {
+        hal_autolatch_start();
+    }
+}
+
+void replay_reset(void)
+{
+    int i;
+
+    input_ptr = 0;
+    buf_ptr = 0;
+    ring_tail_seen = 0;
+    ring_head_seen = 0;
+    ring_underruns = 0;
+    ring_dropped = 0;
+    playing = 0;
+    count = 0;
+    latches = 0;
+    latched = 0;
+    deferred_seen = 0;
+    timed = 0;
+    timed_seen = 0;
+    latch_advanced = 0;
+    autolatched = 0;
+    autolatched_seen = 0;
+    ring_resync = 0;
+    stage_misses = 0;
+    blocksize = 0;
+    decode = decode_select(0, 0, 0);
+    ring_select(0, 0, 0);
+    rle_open(&wire, decode, 0, wire_buf, wire_buf, NULL);
+    wire_pending = 0;
+    autofilled = 0;
+    autolatch = 0;
+    flash_active = 0;
+
+    hal_latch_irq_stop();
+    hal_latch_dma_stop();
+
+    /* reset autolatcher */
+    hal_autolatch_stop();
+    hal_autolatch_period(16);
+    hal_autolatch_select(0);
+
+    /* Reset timers to default */
+    hal_clock_filter_period(0, 2);
+    hal_clock_filter_period(1, 2);
+    hal_window_period(0, 2500);
+    hal_window_period(1, 2500);
+
+    disable_timer = 0;
+    use_timer = 0;
+    timer_ready = 0;
+    window_off = -1;
+
+    cmd_mode_start = -1;
+    cmd_mode_no_data = 0;
+    cmd_mode_cmd_sent = 0;
+
+    credit_mode = 0;
+    credit = 0;
+
+    events_clear();
+
+    vis_enabled = VIS_ENABLE;
+
+    telemetry_period = 0;
+    telemetry_reset();
+    timing_reset();
+
+    for(i = 0; i < RING_BYTES; i += 4)
+    {
+        *(volatile uint32 *)&input[i] = 0;
+    }
+    ring_fetch(0);
+
+    hal_console_write(0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF);
+
+    if(JOYBUS)
+    {
+        /* the pad answers with nothing pressed until a run starts */
+        ring_blank();
+        hal_joybus_start();
+    }
+}
+
+void replay_step(void)
+{
+    usbin_packet *pkt;
+    uint8 grant[3];
+    uint32 usb_start;
+    uint8 cmd;
+    int i;
+
+    if(playing)
+    {
+        if(wire_pending)
+        {
+            /* the host has been sent everything it asked for, it waits */
+            wire_expand();
+        }
+        else if(flash_active)
+        {
+            /* the movie is on the device, the host is not asked for anything */
+            flash_fill();
+        }
+        else if (credit_mode)
+        {
+            /* advertise free ring space not already promised to the host */
+            i = ring_free() - credit;
+            if(i >= CREDIT_MIN_GRANT && hal_usb_configured())
+            {
+                grant[0] = 0xE;
+                grant[1] = (i >> 8) & 0xFF;
+                grant[2] = i & 0xFF;
+                hal_usb_write(grant, 3);
+                credit += i;
+                telemetry_request();
+            }
+
+            if (cmd_mode_cmd_sent && hal_usb_configured())
+            {
+                hal_usb_putc(0xD);
+                cmd_mode_cmd_sent = 0;
+            }
+        }
+        else if (request == 0)
+        {
+            i = ring_free();
+            if(i != (ring_size - 1) && i > 65)
+            {
+                if (hal_usb_configured())
+                {
+                    hal_usb_putc(0xF);
+                    request = 1;
+                    telemetry_request();
+                }
+            }
+        }
+        else if (cmd_mode_cmd_sent)
+        {
+            if (hal_usb_configured())
+            {
+                hal_usb_putc(0xD);
+                cmd_mode_cmd_sent = 0;
+            }
+        }
+    }
+
+    vis_update();
+    timing_step();
+    telemetry_step();
+
+    if (hal_usb_configured())
+    {
+        usb_start = timing_start();
+        usbin_poll();
+        pkt = usbin_peek();
+
+        /* frame data waits for the 0x10 packet before it */
+        if (NULL != pkt && !(wire_pending && (pkt->data[0] == 0xF || pkt->data[0] == 0x10)))
+        {
+            cmd = pkt->data[0];
+            replay_command(pkt);
+
+            /* frame data is the time critical path, the rest is setup */
+            if(TIMING_ENABLE && (cmd == 0xF || cmd == 0x10))
+            {
+                timing_record(TIMING_USB, hal_cycles() - usb_start);
+            }
+        }
+    }
+}
+
+/* 0xC0 turning the autolatch on or off during a run. It counts from the
+ * clocks of the latch just presented. A run that takes it on leaves the
+ * latch DMA for the latch ISR, as replay_begin would have chosen; one that
+ * drops it still skips a console latch an autolatch has already served. */
+static void autolatch_switch(int on)
+{
+    if(on)
+    {
+        if(LATCH_DMA && !JOYBUS)
+        {
+            hal_latch_dma_stop();
+            hal_latch_irq_start();
+        }
+        hal_autolatch_ack();
+        hal_autolatch_reload(autobits);
+        hal_autolatch_start();
+    }
+    else
+    {
+        hal_autolatch_stop();
+    }
+}
+
+/* A setting command, from the host or from the event table when its latch
+ * comes. The payload is the two bytes after the command. */
+void replay_setting(const uint8 *buffer)
+{
+    switch(buffer[0])
+    {
+        case 0xA0:
+        {
+            hal_window_period(0, (buffer[1]<<8) + (buffer[2]&0xFF));
+            break;
+        }
+        case 0xA1:
+        {
+            window_off = (buffer[1]<<8) + (buffer[2]&0xFF);
+            break;
+        }
+        case 0xA2:
+        {
+            disable_timer = 1;
+            break;
+        }
+        case 0xA3:
+        {
+            disable_timer = 0;
+            use_timer = 1;
+            timer_ready= 1;
+            break;
+        }
+        case 0xA4:
+        {
+            hal_clock_filter_period(0, buffer[1]);
+            break;
+        }
+        case 0xB4:
+        {
+            hal_clock_filter_period(1, buffer[1]);
+            break;
+        }
+        case 0xC0:
+        {
+            hal_autolatch_select(buffer[2]);
+            if(playing && !autolatch != !buffer[1])
+            {
+                autolatch_switch(buffer[1]);
+            }
+            autolatch = buffer[1];
+            break;
+        }
+        case 0xC1:
+        {
+            autobits = buffer[1];
+            hal_autolatch_period(buffer[1]);
+            break;
+        }
+        case 0xD0:
+        {
+            cmd_mode_start = (buffer[1]<<8) + (buffer[2]&0xFF);
+            break;
+        }
+    }
+}
+
+void replay_command(usbin_packet *pkt)
+{
+    /* Decode in place from the staging slot */
+    uint8 *buffer = pkt->data;
+    uint8 cmd = buffer[0];
+    const flash_header *img;
+    int k = 0, frames = 0;
+
+    bytes = pkt->bytes;
+
+    switch(cmd)
+    {
+        case 0:
+        {
+            replay_reset();
+            break;
+        }
+        case 1:
+        case 2:
+        {
+            replay_configure(buffer[1], buffer[2], buffer[3], buffer[4]);
+
+            /* 0x02 resumes a run: the host streams from the frame at this
+             * latch and the count goes on from it */
+            if(cmd == 2)
+            {
+                latches = (int)(((uint32)buffer[5] << 24) | ((uint32)buffer[6] << 16)
+                                | ((uint32)buffer[7] << 8) | buffer[8]);
+            }
+
+            /* done with the command packet, the preload reuses the slots */
+            usbin_release();
+            pkt = NULL;
+
+            /* a 0x10 packet that fills the ring ends it early */
+            for(k = 0; k < 4 * blocksize && !wire_pending; k++)
+            {
+                hal_usb_putc(0x0F);
+
+                pkt = usbin_wait();
+                bytes = pkt->bytes;
+                if(blocksize > 0 && pkt->data[0] == 0x10)
+                {
+                    wire_open(pkt->data, bytes);
+                    wire_expand();
+                }
+                else if(blocksize > 0)
+                {
+                    decode(pkt->data + 1, (bytes - 1) / blocksize);
+                }
+                usbin_release();
+            }
+            pkt = NULL;
+
+            replay_begin();
+            break;
+        }
+        case 0xF:
+        {
+            telemetry_data();
+
+            /* synchronous send to both ports with interleaved data */
+            if(blocksize > 0)
+            {
+                frames = decode(buffer + 1, (bytes - 1) / blocksize);
+
+                credit -= frames;
+                if(credit < 0)
+                {
+                    credit = 0;
+                }
+            }
+            request = 0;
+            break;
+        }
+        case 0x10:
+        {
+            telemetry_data();
+
+            /* run length coded frames, expanded as far as the ring allows */
+            if(blocksize > 0)
+            {
+                wire_open(buffer, bytes);
+                wire_expand();
+            }
+            else
+            {
+                request = 0;
+            }
+            break;
+        }
+        case 0xE:
+        {
+            /* switch between single packet requests and credit based refill */
+            credit_mode = buffer[1];
+            credit = 0;
+            break;
+        }
+        case 0xE0:
+        {
+            /* LED visualization on/off, blanked when turned off */
+#if VIS_ENABLE
+            vis_enabled = buffer[1];
+            if(!vis_enabled)
+            {
+                vis_shown.word[0] = 0;
+                vis_shown.word[1] = 0;
+                hal_vis_write(0, 0, 0, 0);
+            }
+#endif
+            break;
+        }
+        case 0xE1:
+        {
+            /* telemetry every this many latches, 0 is off */
+            telemetry_period = (buffer[1]<<8) + (buffer[2]&0xFF);
+            telemetry_reset();
+            break;
+        }
+        case 0xE2:
+        {
+            /* ISR timing, cleared afterwards if asked to */
+            timing_report(buffer[1]);
+            break;
+        }
+        case 0xA0:
+        case 0xA1:
+        case 0xA2:
+        case 0xA3:
+        case 0xA4:
+        case 0xB4:
+        case 0xC0:
+        case 0xC1:
+        case 0xD0:
+        {
+            replay_setting(buffer);
+            break;
+        }
+        case 0xA5:
+        {
+            /* settings to apply at given latches, sent before 0x01 */
+            events_add(buffer, bytes);
+            break;
+        }
+        case 0xA6:
+        {
+            /* window mode ranges, as events */
+            events_add_windows(buffer, bytes);
+            break;
+        }
+        case 0xD1:
+        {
+            // Resync
+            cmd_mode_no_data = 1;
+            ring_resync = 1;
+        }
+        // falls through - answered as a ping
+        case 0xFF:
+        {
+            hal_usb_putc(0xFF);
+            break;
+        }
+        case 0xF0:
+        {
+            /* flash upload, nothing plays while rows are written */
+            replay_reset();
+            flash_upload_begin();
+            break;
+        }
+        case 0xF1:
+        {
+            flash_upload(buffer + 1, bytes - 1);
+            break;
+        }
+        case 0xF2:
+        {
+            flash_upload_end();
+            break;
+        }
+        case 0xF3:
+        {
+            /* play the stored image, 0x0A 0 0 once it runs */
+            img = flash_image();
+            if(img != NULL)
+            {
+                replay_play_flash(img, buffer[1], 0);
+            }
+            flash_reply(img != NULL ? 0 : FLASH_FAILED);
+            break;
+        }
+        case 0xF4:
+        {
+            /* The stored image as the start of a streamed run, if it is the
+             * one the host packed. The host streams from the frame after it
+             * and is asked for nothing until then, so there is no preload. */
+            img = flash_match(buffer + 2);
+            if(img != NULL)
+            {
+                replay_play_flash(img, buffer[1], 1);
+            }
+            flash_reply(img != NULL ? 0 : FLASH_FAILED);
+            break;
+        }
+        case 0xF5:
+        {
+            /* lets the host skip uploading an image the device already has */
+            flash_reply(flash_match(buffer + 1) != NULL ? 0 : FLASH_FAILED);
+            break;
+        }
+    }
+
+    if (NULL != pkt)
+    {
+        usbin_release();
+    }
+}
+
+/* Play an image flash_image accepted. The ring is filled from flash before
+ * the first latch; with handover USB refills follow the last frame. */
+void replay_play_flash(const flash_header *img, int timer, int handover)
+{
+    replay_configure(img->databits, img->ports, img->lines, timer);
+    flash_open(img, handover);
+    flash_fill();
+    replay_begin();
+}
+
+/* P1_IRQ: console latched port 1 */
+void replay_latch_isr(void)
+{
+    uint32 start = timing_start();
+
+    if(autofilled == 0)
+    {
+        hal_console_write(data->line[0], data->line[1], data->line[2], data->line[3]);
+
+        if(playing)
+        {
+            latch_advanced = !use_timer;
+            if(latch_advanced)
+            {
+                latched++;
+            }
+            hal_defer();
+        }
+    } else {
+        autofilled = 0;
+    }
+
+    if(autolatch)
+    {
+        hal_autolatch_reload(autobits);
+    }
+
+    timing_end(TIMING_LATCH, start);
+}
+
+/* LatchDMA_IRQ: the latch DMA has presented the staged frame, the latch
+ * ISR without the register writes */
+void replay_latch_dma_isr(void)
+{
+    uint32 start = timing_start();
+
+    if(playing)
+    {
+        latch_advanced = !use_timer;
+        if(latch_advanced)
+        {
+            latched++;
+        }
+        hal_defer();
+    }
+
+    timing_end(TIMING_LATCH, start);
+}
+
+/* Joybus_IRQ: the joybus component answered a poll with the staged frame
+ * and its FIFOs are empty. A poll is a latch, there is no window to wait
+ * for; between runs the blank frame goes back in for the next poll. */
+void replay_joybus_isr(void)
+{
+    uint32 start = timing_start();
+
+    if(playing)
+    {
+        latch_advanced = 1;
+        latched++;
+        hal_defer();
+    }
+    else
+    {
+        hal_joybus_stage(data->line);
+    }
+
+    timing_end(TIMING_LATCH, start);
+}
+
+/* ClockCounter_IRQ's share of replay_deferred: command mode, then the next frame */
+static void autolatch_deferred(void)
+{
+    int ptr;
+
+    if(use_timer)
+    {
+        return;
+    }
+
+    // based on latch count, are we now in cmd mode?
+    if (cmd_mode_start != -1 && latches >= cmd_mode_start)
+    {
+        // Every 300 bytes starting at cmd_mode_start, check if there is enough data in the buffer to send
+        if ((latches - cmd_mode_start) % 300 == 0)
+        {
+            // If we just successfully sent a command
+            if (latches > cmd_mode_start && !cmd_mode_no_data)
+            {
+                // Send a command to the PC
+                cmd_mode_cmd_sent = 1;
+            }
+
+            if (ring_fill() >= 300)
+            {
+                cmd_mode_no_data = 0;
+            }
+            else
+            {
+                // check if there is data available
+                // if not
+                cmd_mode_no_data = 1;
+            }
+        }
+    }
+    else
+    {
+        cmd_mode_no_data = 0;
+    }
+
+    if (cmd_mode_no_data)
+    {
+        ring_blank();
+    }
+    else
+    {
+        ptr = ring_advance(1);
+        ring_fetch(ptr);
+    }
+
+    latches++;
+    sent = 1;
+    events_check();
+}
+
+/* PendSV: catch up with the latches, window timeouts and autolatches taken
+ * since the last run and stage the next frame */
+void replay_deferred(void)
+{
+    uint32 start = timing_start();
+    int seen = latched;
+    int n = seen - deferred_seen;
+    int ptr;
+
+    if(!playing)
+    {
+        return;
+    }
+
+    vis_mirror();
+
+    if(ring_resync)
+    {
+        /* drop everything queued, the frame staged from it included: the
+         * next latch takes the first frame written after the 0xD1 and until
+         * it comes buttons are released */
+        ring_resync = 0;
+        ring_drop();
+        ring_blank();
+    }
+
+    if(n > 0)
+    {
+        deferred_seen = seen;
+
+        ptr = ring_advance(n);
+        ring_fetch(ptr);
+
+        /* more than one means a latch came before its frame was staged */
+        stage_misses += n - 1;
+        latches += n;
+        sent = 1;
+        events_check();
+    }
+
+    /* one frame per window, the window may end on any of them */
+    seen = timed;
+    for(n = seen - timed_seen; n > 0 && use_timer; n--)
+    {
+        ptr = ring_advance(1);
+        ring_fetch(ptr);
+
+        latches++;
+        sent = 1;
+        events_check();
+
+        if(disable_timer == 1 || latches == window_off)
+        {
+            use_timer = 0;
+            disable_timer = 0;
+        }
+    }
+    timed_seen = seen;
+
+    seen = autolatched;
+    for(n = seen - autolatched_seen; n > 0; n--)
+    {
+        autolatch_deferred();
+    }
+    autolatched_seen = seen;
+
+    timing_end(TIMING_DEFERRED, start);
+}
+
+/* P1_TimerIRQ: latch window on port 1 closed */
+void replay_timer_isr(void)
+{
+    uint32 start = timing_start();
+
+    if(autofilled == 0 && playing && use_timer && !latch_advanced)
+    {
+        timed++;
+        hal_defer();
+    }
+
+    timing_end(TIMING_TIMER, start);
+}
+
+/* ClockCounter_IRQ: autolatch after autobits clocks */
+void replay_autolatch_isr(void)
+{
+    uint32 start = timing_start();
+
+    hal_console_write(data->line[0], data->line[1], data->line[2], data->line[3]);
+
+    if(playing)
+    {
+        /* the console latch that follows was served here */
+        autofilled = 1;
+        autolatched++;
+        hal_defer();
+    }
+    hal_autolatch_ack();
+
+    timing_end(TIMING_AUTOLATCH, start);
+}
+
+/* [] END OF FILE */
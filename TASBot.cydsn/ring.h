@@ -0,0 +1,180 @@
+/* ========================================
+ * Replay ring
+ *
+ * The main loop writes frames at buf_ptr, the
+ * latch path reads them at input_ptr. The frame
+ * count depends on the session's frame width (see
+ * ring_select in decode.c) and is not a power of
+ * two, so positions wrap by compare and subtract;
+ * nothing here divides. One frame is always left
+ * unused so buf_ptr == input_ptr means empty.
+ *
+ * It is a single producer, single consumer ring:
+ * only the main loop moves buf_ptr and only the
+ * latch path moves input_ptr. Frames are written
+ * before buf_ptr is published (with a DMB between),
+ * and each side keeps its own copy of the other's
+ * index, rereading it only when the copy says
+ * there is not enough room or data.
+ * ========================================
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <hal.h>
+
+/* Ring storage. The wired lines of a frame are packed to 1 to 8 bytes, so
+ * the ring holds 6144 frames for 2 port 2 line 16-bit runs up to 49152 for
+ * one 8-bit line. The rest of the 64 KB SRAM is left for the stack, USB and
+ * the other globals. */
+#define RING_BYTES 0xC000
+
+extern volatile uint8 input[RING_BYTES];
+extern volatile int input_ptr;
+extern volatile int buf_ptr;
+
+/* frames held and log2 of the frame width, set by ring_select */
+extern volatile int ring_size;
+extern volatile int ring_shift;
+
+/* the producer's copy of input_ptr and the consumer's copy of buf_ptr */
+extern int ring_tail_seen;
+extern int ring_head_seen;
+
+/* frames the consumer wanted to advance past buf_ptr */
+extern volatile int ring_underruns;
+
+/* set by ring_drop until the consumer has a frame again */
+extern int ring_dropped;
+
+/* ring position after ptr */
+static inline int ring_next(int ptr)
+{
+    if(++ptr == ring_size)
+    {
+        ptr = 0;
+    }
+    return ptr;
+}
+
+/* ring position count frames after ptr, count is at most ring_size */
+static inline int ring_add(int ptr, int count)
+{
+    ptr += count;
+    if(ptr >= ring_size)
+    {
+        ptr -= ring_size;
+    }
+    return ptr;
+}
+
+/* frames from position from up to position to */
+static inline int ring_distance(int from, int to)
+{
+    int d = to - from;
+
+    if(d < 0)
+    {
+        d += ring_size;
+    }
+    return d;
+}
+
+/* frames between input_ptr and buf_ptr, the current frame included */
+static inline int ring_fill(void)
+{
+    return ring_distance(input_ptr, buf_ptr);
+}
+
+/* frames that can be written before buf_ptr would catch up with input_ptr */
+static inline int ring_free(void)
+{
+    return (ring_size - 1) - ring_fill();
+}
+
+/* producer: room for at least want frames if there is, from the cached
+ * input_ptr unless that says there is too little */
+static inline int ring_writable(int want)
+{
+    int room = (ring_size - 1) - ring_distance(ring_tail_seen, buf_ptr);
+
+    if(room < want)
+    {
+        ring_tail_seen = input_ptr;
+        room = (ring_size - 1) - ring_distance(ring_tail_seen, buf_ptr);
+    }
+    return room;
+}
+
+/* producer: make everything written up to ptr visible to the consumer */
+static inline void ring_publish(int ptr)
+{
+    hal_dmb();
+    buf_ptr = ptr;
+}
+
+/* consumer: drop every published frame, moving input_ptr ring_fill()
+ * frames on to buf_ptr. The ring is left empty and nothing in it is the
+ * consumer's; the next ring_advance takes the first frame published after
+ * this. */
+static inline void ring_drop(void)
+{
+    ring_head_seen = buf_ptr;
+    input_ptr = ring_head_seen;
+    ring_dropped = 1;
+}
+
+/* consumer: move input_ptr count frames on, or as far as published frames
+ * go, and return the new position. The frame at input_ptr stays the
+ * consumer's until it moves again. After ring_drop the first frame taken is
+ * the one at input_ptr; until it is published this returns -1 and counts
+ * no underrun. */
+static inline int ring_advance(int count)
+{
+    int ptr = input_ptr;
+    int ahead;
+
+    if(ring_dropped)
+    {
+        ring_head_seen = buf_ptr;
+        hal_dmb();
+        if(ring_head_seen == ptr)
+        {
+            return -1;
+        }
+        ring_dropped = 0;
+        count--;
+    }
+
+    ahead = ring_distance(ptr, ring_head_seen) - 1;
+
+    if(ahead < count)
+    {
+        ring_head_seen = buf_ptr;
+        hal_dmb();
+        ahead = ring_distance(ptr, ring_head_seen) - 1;
+        if(ahead < count)
+        {
+            if(ahead < 0)
+            {
+                ahead = 0;
+            }
+            ring_underruns += count - ahead;
+            count = ahead;
+        }
+    }
+
+    ptr = ring_add(ptr, count);
+    input_ptr = ptr;
+    return ptr;
+}
+
+/* first byte of the frame at ring position ptr */
+static inline uint8 *ring_frame(int ptr)
+{
+    return (uint8 *)&input[ptr << ring_shift];
+}
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,123 @@
+/* ========================================
+ * Replay telemetry
+ *
+ * The USB turnaround is taken from a refill
+ * request or grant to the first 0x0F packet after
+ * it. Ring fill is sampled on every main loop pass,
+ * which runs far more often than the console
+ * latches.
+ * ========================================
+ */
+
+#include <main.h>
+#include <telemetry.h>
+#include <timing.h>
+
+volatile int telemetry_period = 0;
+
+static int reported = 0;
+static int min_fill = 0;
+static int waiting = 0;
+static uint32 asked_at = 0;
+static uint32 turn_max = 0;
+static uint32 turn_total = 0;
+static uint32 turn_count = 0;
+
+static void put16(uint8 *p, uint32 v)
+{
+    if(v > 0xFFFF)
+    {
+        v = 0xFFFF;
+    }
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
+}
+
+static void put32(uint8 *p, uint32 v)
+{
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+/* start a new report period, keeps telemetry_period */
+void telemetry_reset(void)
+{
+    reported = latches;
+    min_fill = ring_size;
+    waiting = 0;
+    turn_max = 0;
+    turn_total = 0;
+    turn_count = 0;
+    timing_isr_peak();
+}
+
+/* main loop asked the host for frames */
+void telemetry_request(void)
+{
+    if(!waiting)
+    {
+        asked_at = hal_cycles();
+        waiting = 1;
+    }
+}
+
+/* a 0x0F packet arrived */
+void telemetry_data(void)
+{
+    uint32 t;
+
+    if(waiting)
+    {
+        t = hal_cycles() - asked_at;
+        if(t > turn_max)
+        {
+            turn_max = t;
+        }
+        turn_total += t;
+        turn_count++;
+        waiting = 0;
+    }
+}
+
+void telemetry_step(void)
+{
+    uint8 msg[TELEMETRY_BYTES];
+    int fill, now;
+
+    if(!telemetry_period || !playing)
+    {
+        return;
+    }
+
+    fill = ring_fill();
+    if(fill < min_fill)
+    {
+        min_fill = fill;
+    }
+
+    now = latches;
+    if(now - reported < telemetry_period || !hal_usb_configured())
+    {
+        return;
+    }
+
+    msg[0] = TELEMETRY_MSG;
+    put32(&msg[1], now);
+    put32(&msg[5], ring_underruns);
+    put16(&msg[9], stage_misses);
+    put16(&msg[11], min_fill);
+    put16(&msg[13], timing_isr_peak());
+    put16(&msg[15], turn_max / HAL_CYCLES_PER_US);
+    put16(&msg[17], turn_count ? turn_total / turn_count / HAL_CYCLES_PER_US : 0);
+    hal_usb_write(msg, TELEMETRY_BYTES);
+
+    reported = now;
+    min_fill = ring_size;
+    turn_max = 0;
+    turn_total = 0;
+    turn_count = 0;
+}
+
+/* [] END OF FILE */
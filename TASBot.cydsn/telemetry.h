@@ -0,0 +1,34 @@
+/* ========================================
+ * Replay telemetry
+ *
+ * Opt-in report of what the replay actually did,
+ * to tell a host that starved the ring apart from
+ * trouble on the console side. 0xE1 sets the
+ * latches between reports; the main loop then sends
+ * a 0x0C report on the same USB stream as the
+ * refill requests whenever that many latches have
+ * passed. The longest ISR time comes from the ISR
+ * timing (timing.c), everything else is sampled by
+ * the main loop.
+ * ========================================
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <hal.h>
+
+#define TELEMETRY_MSG   0x0C
+/* message byte and payload, see PROTOCOL.md */
+#define TELEMETRY_BYTES 19
+
+/* latches between reports, 0 is off */
+extern volatile int telemetry_period;
+
+void telemetry_reset(void);
+void telemetry_request(void);
+void telemetry_data(void);
+void telemetry_step(void);
+
+#endif
+
+/* [] END OF FILE */
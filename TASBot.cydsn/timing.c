@@ -0,0 +1,153 @@
+/* ========================================
+ * ISR timing, main loop side
+ * ========================================
+ */
+
+#include <main.h>
+#include <timing.h>
+
+typedef struct
+{
+    uint32 calls;
+    uint32 dropped;
+    uint32 min;
+    uint32 max;
+    uint64 total;
+    uint32 hist[TIMING_BUCKETS];
+} timing_stats;
+
+timing_log timing_logs[TIMING_ISR_SLOTS];
+
+static timing_stats stats[TIMING_SLOTS];
+static uint32 collected[TIMING_ISR_SLOTS];
+static uint32 isr_peak = 0;
+
+static void put32(uint8 *p, uint32 v)
+{
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+void timing_reset(void)
+{
+    int i, k;
+
+    for(i = 0; i < TIMING_SLOTS; i++)
+    {
+        stats[i].calls = 0;
+        stats[i].dropped = 0;
+        stats[i].min = 0xFFFFFFFF;
+        stats[i].max = 0;
+        stats[i].total = 0;
+        for(k = 0; k < TIMING_BUCKETS; k++)
+        {
+            stats[i].hist[k] = 0;
+        }
+    }
+    for(i = 0; i < TIMING_ISR_SLOTS; i++)
+    {
+        collected[i] = timing_logs[i].head;
+    }
+    isr_peak = 0;
+}
+
+void timing_record(int slot, uint32 cycles)
+{
+    timing_stats *s = &stats[slot];
+    uint32 limit = 32;
+    int b = 0;
+
+    while(b < TIMING_BUCKETS - 1 && cycles >= limit)
+    {
+        limit <<= 1;
+        b++;
+    }
+
+    s->calls++;
+    s->total += cycles;
+    s->hist[b]++;
+    if(cycles < s->min)
+    {
+        s->min = cycles;
+    }
+    if(cycles > s->max)
+    {
+        s->max = cycles;
+    }
+    if(slot < TIMING_ISR_SLOTS && cycles > isr_peak)
+    {
+        isr_peak = cycles;
+    }
+}
+
+/* collect what the ISRs logged since the last pass */
+void timing_step(void)
+{
+#if TIMING_ENABLE
+    timing_log *log;
+    uint32 head;
+    int i;
+
+    for(i = 0; i < TIMING_ISR_SLOTS; i++)
+    {
+        log = &timing_logs[i];
+        head = log->head;
+        if(head - collected[i] > TIMING_SAMPLES)
+        {
+            /* the main loop was held up, the oldest samples are overwritten */
+            stats[i].dropped += head - collected[i] - TIMING_SAMPLES;
+            collected[i] = head - TIMING_SAMPLES;
+        }
+        while(collected[i] != head)
+        {
+            timing_record(i, log->sample[collected[i] & (TIMING_SAMPLES - 1)]);
+            collected[i]++;
+        }
+    }
+#endif
+}
+
+/* longest ISR collected since the last call */
+uint32 timing_isr_peak(void)
+{
+    uint32 peak = isr_peak;
+
+    isr_peak = 0;
+    return peak;
+}
+
+/* one 0x0B message per slot, optionally starting over afterwards */
+void timing_report(int clear)
+{
+    uint8 msg[TIMING_BYTES];
+    timing_stats *s;
+    int i, k;
+
+    timing_step();
+
+    for(i = 0; i < TIMING_SLOTS; i++)
+    {
+        s = &stats[i];
+        msg[0] = TIMING_MSG;
+        msg[1] = i;
+        put32(&msg[2], s->calls);
+        put32(&msg[6], s->dropped);
+        put32(&msg[10], s->calls ? s->min : 0);
+        put32(&msg[14], s->calls ? (uint32)(s->total / s->calls) : 0);
+        put32(&msg[18], s->max);
+        for(k = 0; k < TIMING_BUCKETS; k++)
+        {
+            put32(&msg[22 + 4 * k], s->hist[k]);
+        }
+        hal_usb_write(msg, TIMING_BYTES);
+    }
+
+    if(clear)
+    {
+        timing_reset();
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,80 @@
+/* ========================================
+ * ISR timing
+ *
+ * Each replay ISR reads the DWT cycle counter on
+ * entry and leaves its duration in a small sample
+ * log on exit; the main loop folds the samples
+ * into per-ISR min/avg/max and a histogram, so an
+ * ISR pays a counter read, a subtract and two
+ * stores. USB packet handling is timed and folded
+ * by the main loop directly. 0xE2 reads the stats
+ * back. Building with TIMING_ENABLE 0 leaves the
+ * ISRs untouched and reports zeros.
+ * ========================================
+ */
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <hal.h>
+
+#ifndef TIMING_ENABLE
+#define TIMING_ENABLE 1
+#endif
+
+/* timed paths, the ISRs first */
+#define TIMING_LATCH      0
+#define TIMING_TIMER      1
+#define TIMING_AUTOLATCH  2
+#define TIMING_DEFERRED   3
+#define TIMING_ISR_SLOTS  4
+#define TIMING_USB        4
+#define TIMING_SLOTS      5
+
+/* under 32 cycles, doubling up to under 2048, then 2048 and over */
+#define TIMING_BUCKETS    8
+
+/* samples an ISR can log before the main loop collects them, a power of two */
+#define TIMING_SAMPLES    16
+
+#define TIMING_MSG        0x0B
+/* message byte, slot and 13 four byte fields, see PROTOCOL.md */
+#define TIMING_BYTES      54
+
+typedef struct
+{
+    volatile uint32 sample[TIMING_SAMPLES];
+    volatile uint32 head;
+} timing_log;
+
+extern timing_log timing_logs[TIMING_ISR_SLOTS];
+
+#if TIMING_ENABLE
+
+#define timing_start() hal_cycles()
+
+/* end of the timed ISR slot that started at cycle count start */
+static inline void timing_end(int slot, uint32 start)
+{
+    timing_log *log = &timing_logs[slot];
+    uint32 head = log->head;
+
+    log->sample[head & (TIMING_SAMPLES - 1)] = hal_cycles() - start;
+    log->head = head + 1;
+}
+
+#else
+
+#define timing_start() 0
+#define timing_end(slot, start) ((void)(start))
+
+#endif
+
+void timing_reset(void);
+void timing_record(int slot, uint32 cycles);
+void timing_step(void);
+uint32 timing_isr_peak(void);
+void timing_report(int clear);
+
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,107 @@
+/* ========================================
+ * USB OUT endpoint staging ring
+ *
+ * Packets are read from the CDC data OUT
+ * endpoint into a small ring of slots and
+ * decoded in place, so the endpoint can be
+ * re-armed before the previous packet has been
+ * unpacked. ReadOutEP still copies each packet
+ * with the CPU: the USBUART component in
+ * TopDesign is in manual mode.
+ *
+ * Moving the component to DMA with automatic
+ * buffer management is still open. The
+ * USBUART_EP_MANAGEMENT_DMA_AUTO path below is
+ * written for it, pointing the endpoint DMA at
+ * the next free slot so nothing is copied, but
+ * it is only built by Simulator/test/usbin_test
+ * against a stubbed endpoint and has not run on
+ * hardware.
+ * ========================================
+ */
+
+#include <usbin.h>
+
+static usbin_packet usbin_ring[USBIN_SLOTS];
+static uint8 usbin_head = 0;
+static uint8 usbin_tail = 0;
+
+#if (USBUART_EP_MANAGEMENT_DMA_AUTO)
+static uint8 usbin_armed = 0;
+#endif
+
+#define USBIN_FULL() ((uint8)(usbin_head - usbin_tail) == USBIN_SLOTS)
+#define USBIN_SLOT(n) (&usbin_ring[(n) & (USBIN_SLOTS - 1u)])
+
+void usbin_reset(void)
+{
+    usbin_head = 0;
+    usbin_tail = 0;
+#if (USBUART_EP_MANAGEMENT_DMA_AUTO)
+    usbin_armed = 0;
+#endif
+}
+
+void usbin_poll(void)
+{
+    uint8 ep = USBUART_cdc_data_out_ep;
+    usbin_packet *slot;
+
+#if (USBUART_EP_MANAGEMENT_DMA_AUTO)
+    if (usbin_armed && USBUART_OUT_BUFFER_FULL == USBUART_GetEPState(ep))
+    {
+        /* DMA already placed the packet in the slot, just commit it */
+        USBIN_SLOT(usbin_head)->bytes = USBUART_GetEPCount(ep);
+        usbin_head++;
+        usbin_armed = 0;
+    }
+
+    if (!usbin_armed && !USBIN_FULL())
+    {
+        /* Retarget the endpoint DMA before letting the host send again */
+        slot = USBIN_SLOT(usbin_head);
+        (void) USBUART_ReadOutEP(ep, slot->data, USBIN_PACKET_SIZE);
+        USBUART_EnableOutEP(ep);
+        usbin_armed = 1;
+    }
+#else
+    /* When full the packet stays in the endpoint and the host is NAKed */
+    if (!USBIN_FULL() && USBUART_OUT_BUFFER_FULL == USBUART_GetEPState(ep))
+    {
+        /* ReadOutEP re-arms the endpoint once the data is out */
+        slot = USBIN_SLOT(usbin_head);
+        slot->bytes = USBUART_ReadOutEP(ep, slot->data, USBIN_PACKET_SIZE);
+        usbin_head++;
+    }
+#endif
+}
+
+usbin_packet *usbin_peek(void)
+{
+    if (usbin_head == usbin_tail)
+    {
+        return NULL;
+    }
+    return USBIN_SLOT(usbin_tail);
+}
+
+usbin_packet *usbin_wait(void)
+{
+    usbin_packet *pkt;
+
+    while (NULL == (pkt = usbin_peek()))
+    {
+        usbin_poll();
+    }
+    return pkt;
+}
+
+void usbin_release(void)
+{
+    if (usbin_head != usbin_tail)
+    {
+        usbin_tail++;
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,29 @@
+/* ========================================
+ * USB OUT endpoint staging ring
+ * ========================================
+ */
+#ifndef USBIN_H
+#define USBIN_H
+
+#include <hal.h>
+
+#define USBIN_PACKET_SIZE (64u)
+
+/* Must be a power of two */
+#define USBIN_SLOTS (4u)
+
+typedef struct
+{
+    uint8 data[USBIN_PACKET_SIZE];
+    uint16 bytes;
+} usbin_packet;
+
+void usbin_reset(void);
+void usbin_poll(void);
+usbin_packet *usbin_peek(void);
+usbin_packet *usbin_wait(void);
+void usbin_release(void);
+
+#endif
+
+/* [] END OF FILE */